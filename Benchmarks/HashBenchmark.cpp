@@ -0,0 +1,136 @@
+//measures how well HashFunction spreads common kinds of keys and how fast objects look them up
+//it links against the interpreter sources, for example from this folder:
+//g++ -std=c++11 -O2 -pthread -I.. HashBenchmark.cpp ../Value.cpp ../JetObject.cpp ../JetContext.cpp ../GarbageCollector.cpp
+//    ../GCHeap.cpp ../GCMarker.cpp ../Compiler.cpp ../Expressions.cpp ../Lexer.cpp ../Parser.cpp ../Parselets.cpp -o HashBenchmark
+
+#include "../JetContext.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace Jet;
+
+//the hashes used before, to compare against
+static size_t OldHash(const Value& v)
+{
+	switch (v.type())
+	{
+	case ValueType::Number:
+		return (size_t)v.value();
+	case ValueType::Integer:
+		return (size_t)v.integer();
+	case ValueType::String:
+		{
+			const char* p = v._string();
+			size_t tot = *p;
+			while (*(p++))
+			{
+				tot *= *p;
+				tot -= 3*(*p);
+			}
+			return tot;
+		}
+	default:
+		return (size_t)v._object();
+	}
+}
+
+//the fraction of keys that land in a bucket that is already taken, in a table twice the number of keys
+template<class T>
+static double CollisionRate(const std::vector<Value>& keys, T hash)
+{
+	size_t buckets = 1;
+	while (buckets < keys.size()*2)
+		buckets *= 2;
+
+	std::vector<bool> used(buckets);
+	size_t collisions = 0;
+	for (auto& key: keys)
+	{
+		size_t b = hash(key) & (buckets-1);
+		if (used[b])
+			collisions++;
+		used[b] = true;
+	}
+	return (double)collisions/(double)keys.size();
+}
+
+//nanoseconds per successful lookup in an object holding all the keys
+static double LookupTime(const std::vector<Value>& keys)
+{
+	Shape root;
+	_JetObjectBacking obj(&root);
+	for (unsigned int i = 0; i < keys.size(); i++)
+		obj[keys[i]] = Value((int)i);
+
+	const int rounds = 20;
+	long long found = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (auto& key: keys)
+			found += obj.Find(key) != 0;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	if (found != (long long)keys.size()*rounds)
+		printf("lookup failed!\n");
+
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()/(double)found;
+}
+
+int main()
+{
+	const int count = 100000;
+	std::vector<std::string> storage;//keeps the characters of the string keys alive
+	storage.reserve(count*2);
+
+	std::vector<std::pair<const char*, std::vector<Value>>> sets;
+
+	std::vector<Value> names;
+	for (int i = 0; i < count; i++)
+	{
+		storage.push_back("key" + std::to_string(i));
+		names.push_back(storage.back().c_str());
+	}
+	sets.push_back(std::make_pair("names", names));
+
+	//strings made of only two different characters
+	std::vector<Value> repeats;
+	for (int i = 0; i < count; i++)
+	{
+		std::string s;
+		for (int b = 0; b < 20; b++)
+			s += (i >> b) & 1 ? 'b' : 'a';
+		storage.push_back(s);
+		repeats.push_back(storage.back().c_str());
+	}
+	sets.push_back(std::make_pair("repeats", repeats));
+
+	std::vector<Value> sparse;
+	for (int i = 0; i < count; i++)
+		sparse.push_back(Value((long long)i*1024));
+	sets.push_back(std::make_pair("sparse integers", sparse));
+
+	std::vector<Value> fractions;
+	for (int i = 0; i < count; i++)
+		fractions.push_back(Value((double)i/(double)count));
+	sets.push_back(std::make_pair("fractions", fractions));
+
+	//objects are allocated on the heap, so their addresses are spaced out and aligned
+	std::vector<_JetObject> objects(count);
+	std::vector<Value> pointers;
+	for (int i = 0; i < count; i++)
+		pointers.push_back(Value(&objects[i]));
+	sets.push_back(std::make_pair("objects", pointers));
+
+	printf("%-16s %12s %12s %14s\n", "keys", "old collide", "new collide", "ns per lookup");
+	for (auto& set: sets)
+	{
+		double oldrate = CollisionRate(set.second, OldHash);
+		double newrate = CollisionRate(set.second, HashFunction());
+		printf("%-16s %11.1lf%% %11.1lf%% %14.1lf\n", set.first, oldrate*100.0, newrate*100.0, LookupTime(set.second));
+	}
+	return 0;
+}
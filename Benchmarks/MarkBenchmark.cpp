@@ -0,0 +1,81 @@
+//measures the pause of major collections on large object graphs with different numbers of marking threads
+//it links against the interpreter sources, for example from this folder:
+//g++ -std=c++11 -O2 -pthread -I.. MarkBenchmark.cpp ../Value.cpp ../JetObject.cpp ../JetContext.cpp ../GarbageCollector.cpp
+//    ../GCHeap.cpp ../GCMarker.cpp ../Compiler.cpp ../Expressions.cpp ../Lexer.cpp ../Parser.cpp ../Parselets.cpp -o MarkBenchmark
+
+#include "../JetContext.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Jet;
+
+//a wide graph, lots of small objects hanging off one big array
+static const char* Wide =
+	"nodes = [];"
+	"nodes:resize(50000);"
+	"for (local i = 0; i < 50000; i++)"
+	"{"
+	"	nodes[i] = {a = {v = i}, b = [i, i], c = {v = i}};"
+	"}";
+
+//a deep graph, a binary tree built by recursion
+static const char* Tree =
+	"build = fun(depth) {"
+	"	if (depth == 0)"
+	"		return {v = 0};"
+	"	return {left = build(depth - 1), right = build(depth - 1), v = depth};"
+	"};"
+	"tree = build(19);";
+
+//times a collection, with the pacing from Run they are all major
+static double MajorPause(JetContext& context)
+{
+	auto start = std::chrono::steady_clock::now();
+	context.RunGC();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Run(const char* name, const char* code, unsigned int maxthreads)
+{
+	JetContext context;
+	context.Script(code, name);
+
+	//no growth needed for a major collection
+	GCPacing pacing;
+	pacing.growth = 0;
+	pacing.minheap = 0;
+	context.SetGCPacing(pacing);
+
+	printf("%s\n", name);
+	double serial = 0;
+	for (unsigned int threads = 1; threads <= maxthreads; threads++)
+	{
+		context.SetGCThreads(threads);
+
+		//best of a few, the first collections also promote everything
+		double best = 1e30;
+		for (int i = 0; i < 5; i++)
+		{
+			double ms = MajorPause(context);
+			if (ms < best)
+				best = ms;
+		}
+		if (threads == 1)
+			serial = best;
+		printf("  %2u threads: %8.2f ms  %5.2fx\n", threads, best, serial/best);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int maxthreads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+	if (maxthreads == 0)
+		maxthreads = 4;
+
+	Run("wide", Wide, maxthreads);
+	Run("tree", Tree, maxthreads);
+	return 0;
+}
@@ -16,7 +16,8 @@ using namespace Jet;
 CompilerContext::CompilerContext(void)
 {
 	this->vararg = false;
-	this->closures = 0;
+	this->registers = false;
+	this->superinstructions = false;
 	this->parent = 0;
 	this->uuid = 0;
 	this->localindex = 0;
@@ -94,12 +95,12 @@ std::vector<IntermediateInstruction> CompilerContext::Compile(BlockExpression* e
 
 		if (localindex > 255)
 			throw CompilerException(this->lastfile, this->lastline, "Too many locals: over 256 locals in function!");
-		if (closures > 255)
-			throw CompilerException(this->lastfile, this->lastline, "Too many closures: over 256 closures in function!");
+		if (captures.size() > 255)
+			throw CompilerException(this->lastfile, this->lastline, "Too many captures: over 256 captured variables in function!");
 
 		//modify the entry point with number of locals
 		this->out[0].b = this->localindex;
-		this->out[0].c = this->closures;
+		this->out[0].c = this->captures.size();
 	}
 	catch (CompilerException e)
 	{
@@ -123,7 +124,7 @@ std::vector<IntermediateInstruction> CompilerContext::Compile(BlockExpression* e
 		this->functions.clear();
 
 		this->localindex = 0;
-		this->closures = 0;
+		this->captures.clear();
 
 		throw e;
 	}
@@ -147,15 +148,130 @@ std::vector<IntermediateInstruction> CompilerContext::Compile(BlockExpression* e
 	this->functions.clear();
 	//add metamethods and custom operators
 	this->localindex = 0;
-	this->closures = 0;
+	this->captures.clear();
 
 	//this->PrintAssembly();
 
 	auto temp = std::move(this->out);
 	this->out.clear();
+
+	if (this->registers)
+		this->RegisterPass(temp);
+
+	if (this->superinstructions)
+		this->SuperinstructionPass(temp);
+
 	return std::move(temp);
 }
 
+//returns the register version of a stack operation
+static bool RegisterOperation(InstructionType type, InstructionType& out)
+{
+	switch (type)
+	{
+	case InstructionType::Add:
+		out = InstructionType::RAdd;
+		return true;
+	case InstructionType::Sub:
+		out = InstructionType::RSub;
+		return true;
+	case InstructionType::Mul:
+		out = InstructionType::RMul;
+		return true;
+	case InstructionType::Div:
+		out = InstructionType::RDiv;
+		return true;
+	case InstructionType::Modulus:
+		out = InstructionType::RModulus;
+		return true;
+	default:
+		return false;
+	}
+}
+
+//converts sequences of stack instructions that only read and write locals into register instructions
+//LLoad b, LLoad c, <op>, LStore a becomes R<op> a b c
+//LLoad b, LStore a becomes RMove a b
+//labels are separate instructions, so nothing can jump into the middle of a sequence
+void CompilerContext::RegisterPass(std::vector<IntermediateInstruction>& code)
+{
+	std::vector<IntermediateInstruction> out;
+	out.reserve(code.size());
+	for (unsigned int i = 0; i < code.size(); i++)
+	{
+		auto& ins = code[i];
+		if (ins.type == InstructionType::LLoad)
+		{
+			InstructionType op;
+			if (i+3 < code.size() && code[i+1].type == InstructionType::LLoad && RegisterOperation(code[i+2].type, op) && code[i+3].type == InstructionType::LStore)
+			{
+				IntermediateInstruction r(op);
+				r.a = code[i+3].first;
+				r.b = ins.first;
+				r.c = code[i+1].first;
+				out.push_back(r);
+				i += 3;
+				continue;
+			}
+			else if (i+1 < code.size() && code[i+1].type == InstructionType::LStore)
+			{
+				IntermediateInstruction r(InstructionType::RMove);
+				r.a = code[i+1].first;
+				r.b = ins.first;
+				out.push_back(r);
+				i += 1;
+				continue;
+			}
+		}
+		out.push_back(ins);
+	}
+	code = std::move(out);
+}
+
+//fuses the sequences that show up most in opcode pair profiles into single instructions
+//LLoad a, LdInt k, Add/Sub, LStore a becomes LAddInt/LSubInt a k
+//LLoad a, Incr/Decr, LStore a becomes LIncr/LDecr a
+void CompilerContext::SuperinstructionPass(std::vector<IntermediateInstruction>& code)
+{
+	std::vector<IntermediateInstruction> out;
+	out.reserve(code.size());
+	for (unsigned int i = 0; i < code.size(); i++)
+	{
+		auto& ins = code[i];
+		switch (ins.type)
+		{
+		case InstructionType::LLoad:
+			{
+				if (i+3 < code.size() && code[i+1].type == InstructionType::LdInt 
+					&& (code[i+2].type == InstructionType::Add || code[i+2].type == InstructionType::Sub)
+					&& code[i+3].type == InstructionType::LStore && code[i+3].first == ins.first)
+				{
+					IntermediateInstruction r(code[i+2].type == InstructionType::Add ? InstructionType::LAddInt : InstructionType::LSubInt);
+					r.first = ins.first;
+					r.second = code[i+1].second;
+					out.push_back(r);
+					i += 3;
+					continue;
+				}
+				else if (i+2 < code.size() && (code[i+1].type == InstructionType::Incr || code[i+1].type == InstructionType::Decr)
+					&& code[i+2].type == InstructionType::LStore && code[i+2].first == ins.first)
+				{
+					IntermediateInstruction r(code[i+1].type == InstructionType::Incr ? InstructionType::LIncr : InstructionType::LDecr);
+					r.first = ins.first;
+					out.push_back(r);
+					i += 2;
+					continue;
+				}
+				break;
+			}
+		default:
+			break;
+		}
+		out.push_back(ins);
+	}
+	code = std::move(out);
+}
+
 bool CompilerContext::RegisterLocal(const std::string name)
 {
 	//neeed to store locals in a contiguous array, even with different scopes
@@ -168,7 +284,6 @@ bool CompilerContext::RegisterLocal(const std::string name)
 	LocalVariable var;
 	var.local = this->localindex++;
 	var.name = name;
-	var.capture = -1;
 	this->scope->localvars.push_back(var);
 	return true;
 }
@@ -232,6 +347,33 @@ void CompilerContext::BinaryOperation(TokenType operation)
 	}
 }
 
+bool CompilerContext::JumpIfNot(TokenType operation, const char* pos)
+{
+	switch (operation)
+	{
+	case TokenType::LessThan:
+		this->out.push_back(IntermediateInstruction(InstructionType::JumpIfNotLt, pos));
+		return true;
+	case TokenType::GreaterThan:
+		this->out.push_back(IntermediateInstruction(InstructionType::JumpIfNotGt, pos));
+		return true;
+	case TokenType::LessThanEqual:
+		this->out.push_back(IntermediateInstruction(InstructionType::JumpIfNotLtE, pos));
+		return true;
+	case TokenType::GreaterThanEqual:
+		this->out.push_back(IntermediateInstruction(InstructionType::JumpIfNotGtE, pos));
+		return true;
+	case TokenType::Equals:
+		this->out.push_back(IntermediateInstruction(InstructionType::JumpIfNotEq, pos));
+		return true;
+	case TokenType::NotEqual:
+		this->out.push_back(IntermediateInstruction(InstructionType::JumpIfEq, pos));
+		return true;
+	default:
+		return false;
+	}
+}
+
 void CompilerContext::UnaryOperation(TokenType operation)
 {
 	switch (operation)
@@ -273,29 +415,45 @@ CompilerContext* CompilerContext::AddFunction(std::string name, unsigned int arg
 void CompilerContext::FinalizeFunction(CompilerContext* c)
 {
 	this->uuid = c->uuid + 1;
+}
 
-	//move upvalues
-	int level = 0;
-	auto ptr = this->scope;
+int CompilerContext::FindLocal(const std::string& variable)
+{
+	Scope* ptr = this->scope;
 	while (ptr)
 	{
-		//make sure this doesnt upload multiple times
-		//look for var in locals
 		for (unsigned int i = 0; i < ptr->localvars.size(); i++)
 		{
-			if (ptr->localvars[i].capture >= 0 && ptr->localvars[i].uploaded == false)
-			{
-				//printf("We found use of a captured var: %s at level %d, index %d\n", ptr->localvars[i].second.c_str(), level, ptr->localvars[i].first);
-				//exit the loops we found it
-				ptr->localvars[i].uploaded = true;
-				//this->output += ".local " + variable + " " + ::std::to_string(i) + ";\n";
-				out.push_back(IntermediateInstruction(InstructionType::CInit,ptr->localvars[i].local, ptr->localvars[i].capture));
-				//push instruction to set closure location
-				//out.push_back(IntermediateInstruction(InstructionType::LLoad, ptr->localvars[i].first, 0));//i, ptr->level));
-				//out.push_back(IntermediateInstruction(InstructionType::CStore, ptr->localvars[i].third, level));//i, ptr->level));
-			}
+			if (ptr->localvars[i].name == variable)
+				return ptr->localvars[i].local;
 		}
-		if (ptr)
-			ptr = ptr->previous;
+		ptr = ptr->previous;
+	}
+	return -1;
+}
+
+int CompilerContext::Capture(const std::string& variable)
+{
+	if (this->parent == 0)
+		return -1;
+
+	//either a local of the parent or something the parent captured itself
+	CapturedVariable capture;
+	capture.local = true;
+	capture.index = this->parent->FindLocal(variable);
+	if (capture.index < 0)
+	{
+		capture.local = false;
+		capture.index = this->parent->Capture(variable);
+		if (capture.index < 0)
+			return -1;
+	}
+
+	for (unsigned int i = 0; i < this->captures.size(); i++)
+	{
+		if (this->captures[i].local == capture.local && this->captures[i].index == capture.index)
+			return i;
 	}
+	this->captures.push_back(capture);
+	return this->captures.size() - 1;
 }
@@ -109,11 +109,8 @@ namespace Jet
 
 		struct LocalVariable
 		{
-			LocalVariable() { this->uploaded = false; }
 			int local;
 			std::string name;
-			int capture;
-			bool uploaded;
 		};
 
 		struct Scope
@@ -128,7 +125,12 @@ namespace Jet
 		unsigned int localindex;
 
 		bool vararg;
-		unsigned int closures;
+		struct CapturedVariable
+		{
+			bool local;//a local of the parent, otherwise one of its upvalues
+			int index;
+		};
+		std::vector<CapturedVariable> captures;//the upvalues of closures of this function
 		unsigned int arguments;
 		CompilerContext* parent;
 
@@ -141,6 +143,9 @@ namespace Jet
 
 		void PrintAssembly();
 
+		bool registers;//emit register instructions for operations on locals
+		bool superinstructions;//fuse common instruction sequences
+
 		//used when generating functions
 		CompilerContext* AddFunction(std::string name, unsigned int args, bool vararg = false);
 		void FinalizeFunction(CompilerContext* c);
@@ -148,6 +153,9 @@ namespace Jet
 		std::vector<IntermediateInstruction> Compile(BlockExpression* expr);
 
 	private:
+		void RegisterPass(std::vector<IntermediateInstruction>& code);
+		void SuperinstructionPass(std::vector<IntermediateInstruction>& code);
+
 		void Compile()
 		{
 			//append functions to end here
@@ -156,7 +164,12 @@ namespace Jet
 				fun.second->Compile();
 
 				//need to set var with the function name and location
-				this->FunctionLabel(fun.first, fun.second->arguments, fun.second->localindex, fun.second->closures);
+				this->FunctionLabel(fun.first, fun.second->arguments, fun.second->localindex, fun.second->captures.size());
+
+				//then where each upvalue comes from when a closure is made
+				for (auto capture: fun.second->captures)
+					this->out.push_back(IntermediateInstruction(InstructionType::CInit, capture.index, capture.local ? 1 : 0));
+
 				for (auto ins: fun.second->out)
 					this->out.push_back(ins);
 
@@ -227,7 +240,17 @@ namespace Jet
 
 		bool RegisterLocal(const std::string name);//returns success
 
+		//returns the slot of a local in scope or -1
+		int FindLocal(const std::string& variable);
+
+		//returns the upvalue for a local of an enclosing function, adding it if this is the first use, or -1 for globals
+		int Capture(const std::string& variable);
+
 		void BinaryOperation(TokenType operation);
+
+		//jumps to pos unless the comparison of the top two values holds
+		//returns false and emits nothing if operation isnt a comparison
+		bool JumpIfNot(TokenType operation, const char* pos);
 		void UnaryOperation(TokenType operation);
 
 		//stack operations
@@ -251,6 +274,12 @@ namespace Jet
 			out.push_back(IntermediateInstruction(InstructionType::LdNum, (double)0, value));
 		}
 
+		//value must fit in a double exactly, the assembler converts it back
+		void Integer(long long value)
+		{
+			out.push_back(IntermediateInstruction(InstructionType::LdInt, (double)0, (double)value));
+		}
+
 		void String(std::string string)
 		{
 			out.push_back(IntermediateInstruction(InstructionType::LdStr, string.c_str()));
@@ -279,55 +308,19 @@ namespace Jet
 
 		void Store(const std::string variable)
 		{
-			//look up if I am a local or global
-			Scope* ptr = this->scope;
-			while (ptr)
+			//look up if I am a local, an upvalue or a global
+			int local = this->FindLocal(variable);
+			if (local >= 0)
 			{
-				//look for var in locals
-				for (unsigned int i = 0; i < ptr->localvars.size(); i++)
-				{
-					if (ptr->localvars[i].name == variable)
-					{
-						//printf("We found storing of a local var: %s at level %d, index %d\n", variable.c_str(), ptr->level, ptr->localvars[i].first);
-						//exit the loops we found it
-						//this->output += ".local " + variable + " " + ::std::to_string(i) + ";\n";
-						out.push_back(IntermediateInstruction(InstructionType::LStore, ptr->localvars[i].local, 0));//i, ptr->level));
-						return;
-					}
-				}
-				if (ptr)
-					ptr = ptr->previous;
+				out.push_back(IntermediateInstruction(InstructionType::LStore, local, 0));
+				return;
 			}
 
-			int level = -1;
-			auto cur = this->parent;
-			while(cur)//if (this->parent)
-			{
-				ptr = cur->scope;
-				while (ptr)
-				{
-					//look for var in locals
-					for (unsigned int i = 0; i < ptr->localvars.size(); i++)
-					{
-						if (ptr->localvars[i].name == variable)
-						{
-							//printf("We found storing of a captured var: %s at level %d, index %d\n", variable.c_str(), level, ptr->localvars[i].first);
-							//exit the loops we found it
-							//this->output += ".local " + variable + " " + ::std::to_string(i) + ";\n";
-							if (ptr->localvars[i].capture == -1)
-								ptr->localvars[i].capture = cur->closures++;
-
-							out.push_back(IntermediateInstruction(InstructionType::CStore, ptr->localvars[i].capture, level));//i, ptr->level));
-							return;
-						}
-					}
-					if (ptr)
-						ptr = ptr->previous;
-				}
-				level--;
-				cur = cur->parent;
-			}
-			out.push_back(IntermediateInstruction(InstructionType::Store, variable));
+			int capture = this->Capture(variable);
+			if (capture >= 0)
+				out.push_back(IntermediateInstruction(InstructionType::CStore, capture, 0));
+			else
+				out.push_back(IntermediateInstruction(InstructionType::Store, variable));
 		}
 
 		void StoreLocal(const std::string variable)
@@ -336,59 +329,21 @@ namespace Jet
 			this->Store(variable);
 		}
 
-		//this loads locals and globals atm
+		//this loads locals, upvalues and globals
 		void Load(const std::string variable)
 		{
-			Scope* ptr = this->scope;
-			while (ptr)
+			int local = this->FindLocal(variable);
+			if (local >= 0)
 			{
-				//look for var in locals
-				for (unsigned int i = 0; i < ptr->localvars.size(); i++)
-				{
-					if (ptr->localvars[i].name == variable)
-					{
-						//printf("We found loading of a local var: %s at level %d, index %d\n", variable.c_str(), ptr->level, ptr->localvars[i].first);
-						//exit the loops we found it
-						//comment/debug info
-						//this->output += ".local " + variable + " " + ::std::to_string(i) + ";\n";
-						out.push_back(IntermediateInstruction(InstructionType::LLoad, ptr->localvars[i].local, 0));//i, ptr->level));
-						return;
-					}
-				}
-				if (ptr)
-					ptr = ptr->previous;
+				out.push_back(IntermediateInstruction(InstructionType::LLoad, local, 0));
+				return;
 			}
 
-			int level = -1;
-			auto cur = this->parent;
-			while(cur)//if (this->parent)
-			{
-				ptr = cur->scope;
-				while (ptr)
-				{
-					//look for var in locals
-					for (unsigned int i = 0; i < ptr->localvars.size(); i++)
-					{
-						if (ptr->localvars[i].name == variable)
-						{
-							//printf("We found loading of a captured var: %s at level %d, index %d\n", variable.c_str(), level, ptr->localvars[i].first);
-							//exit the loops we found it
-							//comment/debug info
-							//this->output += ".local " + variable + " " + ::std::to_string(i) + ";\n";
-							if (ptr->localvars[i].capture == -1)
-								ptr->localvars[i].capture = cur->closures++;
-
-							out.push_back(IntermediateInstruction(InstructionType::CLoad, ptr->localvars[i].capture, level));//i, ptr->level));
-							return;
-						}
-					}
-					if (ptr)
-						ptr = ptr->previous;
-				}
-				level--;
-				cur = cur->parent;
-			}
-			out.push_back(IntermediateInstruction(InstructionType::Load, variable));
+			int capture = this->Capture(variable);
+			if (capture >= 0)
+				out.push_back(IntermediateInstruction(InstructionType::CLoad, capture, 0));
+			else
+				out.push_back(IntermediateInstruction(InstructionType::Load, variable));
 		}
 
 		bool IsLocal(const std::string variable)
@@ -454,6 +409,14 @@ namespace Jet
 			out.push_back(IntermediateInstruction(InstructionType::ECall, args));
 		}
 
+		//calls a method of the value on top of the stack, which is passed to it after the other args
+		void Invoke(const char* name, unsigned int args)
+		{
+			IntermediateInstruction ins(InstructionType::Invoke, name);
+			ins.first = args + 1;
+			out.push_back(ins);
+		}
+
 		void LoadIndex(const char* index = 0)
 		{
 			out.push_back(IntermediateInstruction(InstructionType::LoadAt, index));
@@ -464,6 +427,39 @@ namespace Jet
 			out.push_back(IntermediateInstruction(InstructionType::StoreAt, index));
 		}
 
+		//the loop state goes in the locals iter and iter+1
+		void IterPrep(int iter)
+		{
+			out.push_back(IntermediateInstruction(InstructionType::IterPrep, iter));
+		}
+
+		void IterNext(int iter, const char* end)
+		{
+			IntermediateInstruction ins(InstructionType::IterNext, end);
+			ins.second = iter;
+			out.push_back(ins);
+		}
+
+		void IterKey(int iter)
+		{
+			out.push_back(IntermediateInstruction(InstructionType::IterKey, iter));
+		}
+
+		//the loop variable is the local var, the counter and limit go in the two after it
+		void ForRangePrep(int var, const char* end)
+		{
+			IntermediateInstruction ins(InstructionType::ForRangePrep, end);
+			ins.second = var;
+			out.push_back(ins);
+		}
+
+		void ForRangeLoop(int var, const char* start)
+		{
+			IntermediateInstruction ins(InstructionType::ForRangeLoop, start);
+			ins.second = var;
+			out.push_back(ins);
+		}
+
 		void NewArray(unsigned int number)
 		{
 			out.push_back(IntermediateInstruction(InstructionType::NewArray, number));
@@ -474,10 +470,27 @@ namespace Jet
 			out.push_back(IntermediateInstruction(InstructionType::NewObject, number));
 		}
 
+		//turns the call that was just compiled into a tail call, the return after it is only reached when calling natives
+		void TailCall()
+		{
+			IntermediateInstruction& call = out.back();
+			if (call.type == InstructionType::Call)
+			{
+				//global calls load the function and call it like any other value
+				unsigned int args = (unsigned int)call.second;
+				call.type = InstructionType::Load;
+				call.second = 0;
+				out.push_back(IntermediateInstruction(InstructionType::TailCall, args));
+			}
+			else if (call.type == InstructionType::ECall)
+				call.type = InstructionType::TailCall;
+			else if (call.type == InstructionType::Invoke)
+				call.type = InstructionType::TailInvoke;
+		}
+
 		void Return()
 		{
-			if (this->closures > 0)//close all open closures
-				out.push_back(IntermediateInstruction(InstructionType::Close));
+			//upvalues are closed by the return itself
 			out.push_back(IntermediateInstruction(InstructionType::Return));
 		}
 
@@ -119,7 +119,10 @@ void NullExpression::Compile(CompilerContext* context)
 
 void NumberExpression::Compile(CompilerContext* context)
 {
-	context->Number(this->value);
+	if (this->integer)
+		context->Integer((long long)this->value);
+	else
+		context->Number(this->value);
 
 	if (dynamic_cast<BlockExpression*>(this->Parent))
 		context->Pop();
@@ -188,18 +191,11 @@ void CallExpression::Compile(CompilerContext* context)
 			for (auto i: *args)
 				i->Compile(context);//pushes args
 
-			//compile left I guess?
-			left->Compile(context);//pushes function
-
-			//ok, fix the order here, this isnt working right
-			//need to insert before the last instruction
-			auto t = context->out.back();
-			context->out.pop_back();//pushes this
-			context->Duplicate();//duplicates this
-			context->out.push_back(t);//pushes function
-			//could just have this as last argument, idk
-			//increase number of args
-			context->ECall(args->size()+1);
+			//then this, which is the last argument
+			index->left->Compile(context);
+
+			//the member parselet only makes string indices
+			context->Invoke(dynamic_cast<StringExpression*>(index->index)->GetValue().c_str(), args->size());
 		}
 		else
 		{
@@ -261,6 +257,21 @@ void OperatorExpression::Compile(CompilerContext* context)
 		context->Pop();
 }
 
+void OperatorExpression::CompileCondition(CompilerContext* context, const char* pos)
+{
+	context->Line(this->_operator.filename, this->_operator.line);
+
+	this->left->Compile(context);
+	this->right->Compile(context);
+
+	//comparisons branch on their own instead of pushing a result for JumpFalse
+	if (context->JumpIfNot(this->_operator.type, pos) == false)
+	{
+		context->BinaryOperation(this->_operator.type);
+		context->JumpFalse(pos);
+	}
+}
+
 void FunctionExpression::Compile(CompilerContext* context)
 {
 	context->Line(token.filename, token.line);
@@ -48,6 +48,13 @@ namespace Jet
 		{
 
 		};
+
+		//compiles the expression as the condition of a branch that goes to pos when it is false
+		virtual void CompileCondition(CompilerContext* context, const char* pos)
+		{
+			this->Compile(context);
+			context->JumpFalse(pos);
+		}
 	};
 
 	class IStorableExpression
@@ -102,6 +109,14 @@ namespace Jet
 			delete this->initializers;
 		}
 
+		void SetParent(Expression* parent)
+		{
+			this->Parent = parent;
+			if (initializers)
+				for (auto ii: *initializers)
+					ii->SetParent(this);
+		}
+
 		void print()
 		{
 			//printf(_name.getText().c_str());
@@ -127,6 +142,14 @@ namespace Jet
 			delete this->inits;
 		}
 
+		void SetParent(Expression* parent)
+		{
+			this->Parent = parent;
+			if (inits)
+				for (auto ii: *inits)
+					ii.second->SetParent(this);
+		}
+
 		void print()
 		{
 			//printf(_name.getText().c_str());
@@ -160,6 +183,13 @@ namespace Jet
 			return "";//this->_name.getText();
 		}
 
+		void SetParent(Expression* parent)
+		{
+			this->Parent = parent;
+			for (auto ii: *_right)
+				ii->SetParent(this);
+		}
+
 		void print()
 		{
 			//printf(_name.getText().c_str());
@@ -171,10 +201,12 @@ namespace Jet
 	class NumberExpression: public Expression
 	{
 		double value;
+		bool integer;
 	public:
-		NumberExpression(double value)
+		NumberExpression(double value, bool integer = false)
 		{
 			this->value = value;
+			this->integer = integer;
 		}
 
 		double GetValue()
@@ -231,6 +263,7 @@ namespace Jet
 	{
 		Expression* left, *index;
 	public:
+		friend class CallExpression;
 		Token token;
 		IndexExpression(Expression* left, Expression* index, Token t)
 		{
@@ -245,6 +278,13 @@ namespace Jet
 			delete index;
 		}
 
+		void SetParent(Expression* parent)
+		{
+			this->Parent = parent;
+			left->SetParent(this);
+			index->SetParent(this);
+		}
+
 		void print()
 		{
 			printf("[");
@@ -467,6 +507,7 @@ namespace Jet
 		}
 
 		void Compile(CompilerContext* context);
+		void CompileCondition(CompilerContext* context, const char* pos);
 	};
 
 	class StatementExpression: public Expression
@@ -595,8 +636,7 @@ namespace Jet
 
 			std::string uuid = context->GetUUID();
 			context->Label("loopstart_"+uuid);
-			this->condition->Compile(context);
-			context->JumpFalse(("loopend_"+uuid).c_str());
+			this->condition->CompileCondition(context, ("loopend_"+uuid).c_str());
 
 			context->PushLoop("loopend_"+uuid, "loopstart_"+uuid);
 			this->block->Compile(context);
@@ -659,8 +699,7 @@ namespace Jet
 			std::string uuid = context->GetUUID();
 			this->initial->Compile(context);
 			context->Label("forloopstart_"+uuid);
-			this->condition->Compile(context);
-			context->JumpFalse(("forloopend_"+uuid).c_str());
+			this->condition->CompileCondition(context, ("forloopend_"+uuid).c_str());
 
 			context->PushLoop("forloopend_"+uuid, "forloopcontinue_"+uuid);
 			this->block->Compile(context);
@@ -676,11 +715,13 @@ namespace Jet
 
 	class ForEachExpression: public Expression
 	{
-		Token name, container;
+		Token key, name;//key has no text if the loop only wants the values
+		Expression* container;
 		ScopeExpression* block;
 	public:
-		ForEachExpression(Token name, Token container, ScopeExpression* block)
+		ForEachExpression(Token key, Token name, Expression* container, ScopeExpression* block)
 		{
+			this->key = key;
 			this->container = container;
 			this->block = block;
 			this->name = name;
@@ -688,12 +729,14 @@ namespace Jet
 
 		~ForEachExpression()
 		{
+			delete this->container;
 			delete this->block;
 		}
 
 		void SetParent(Expression* parent)
 		{
 			this->Parent = parent;
+			container->SetParent(this);
 			block->SetParent(this);
 		}
 
@@ -712,43 +755,107 @@ namespace Jet
 
 		void Compile(CompilerContext* context)
 		{
-			//return;
+			//the container is worked out before the loop variables exist
+			this->container->Compile(context);
+
 			context->PushScope();
 
 			auto uuid = context->GetUUID();
 			context->RegisterLocal(this->name.text);
-			context->RegisterLocal("_iter");
+			if (this->key.text.length())
+				context->RegisterLocal(this->key.text);
 
-			context->Load(this->container.text);
-			context->Duplicate();
-			context->LoadIndex("getIterator");
-			context->ECall(1);
-			context->Store("_iter");
+			//hidden locals for the container and the position in it, they have to be next to each other
+			context->RegisterLocal("_iter");
+			context->RegisterLocal("_iterpos");
+			int iter = context->FindLocal("_iter");
 
+			context->IterPrep(iter);
 
 			context->Label("_foreachstart"+uuid);
-			context->Load("_iter");//this->container.text);
-			context->Duplicate();
-			context->LoadIndex("current");
-			context->ECall(1);
+			context->IterNext(iter, ("_foreachend"+uuid).c_str());
 			context->Store(this->name.text);
+			if (this->key.text.length())
+			{
+				context->IterKey(iter);
+				context->Store(this->key.text);
+			}
 
 			context->PushLoop("_foreachend"+uuid, "_foreachstart"+uuid);
 			this->block->Compile(context);
 			context->PopLoop();
 
-			context->Load("_iter");
-			context->Duplicate();
-			context->LoadIndex("advance");
-			context->ECall(1);
-			context->JumpFalse(("_foreachend"+uuid).c_str());
-
 			context->Jump(("_foreachstart"+uuid).c_str());
 			context->Label("_foreachend"+uuid);
 			context->PopScope();
 		}
 	};
 
+	//counts up from start to one less than end
+	class ForRangeExpression: public Expression
+	{
+		Token name;
+		Expression* start, *end;
+		ScopeExpression* block;
+	public:
+		ForRangeExpression(Token name, Expression* start, Expression* end, ScopeExpression* block)
+		{
+			this->name = name;
+			this->start = start;
+			this->end = end;
+			this->block = block;
+		}
+
+		~ForRangeExpression()
+		{
+			delete this->start;
+			delete this->end;
+			delete this->block;
+		}
+
+		void SetParent(Expression* parent)
+		{
+			this->Parent = parent;
+			start->SetParent(this);
+			end->SetParent(this);
+			block->SetParent(this);
+		}
+
+		void print()
+		{
+		}
+
+		void Compile(CompilerContext* context)
+		{
+			context->Line(name.filename, name.line);
+
+			this->start->Compile(context);
+			this->end->Compile(context);
+
+			context->PushScope();
+
+			//the counter and the limit are hidden locals right after the variable
+			//the loop goes by the counter, so assigning to the variable doesnt change how many times it runs
+			auto uuid = context->GetUUID();
+			context->RegisterLocal(this->name.text);
+			context->RegisterLocal("_iter");
+			context->RegisterLocal("_iterend");
+			int var = context->FindLocal(this->name.text);
+
+			context->ForRangePrep(var, ("_forrangeend"+uuid).c_str());
+			context->Label("_forrangestart"+uuid);
+
+			context->PushLoop("_forrangeend"+uuid, "_forrangenext"+uuid);
+			this->block->Compile(context);
+			context->PopLoop();
+
+			context->Label("_forrangenext"+uuid);
+			context->ForRangeLoop(var, ("_forrangestart"+uuid).c_str());
+			context->Label("_forrangeend"+uuid);
+			context->PopScope();
+		}
+	};
+
 
 	struct Branch
 	{
@@ -835,13 +942,11 @@ namespace Jet
 				if (pos != 0)//no jump label needed on first one
 					context->Label(bname);
 
-				ii->condition->Compile(context);
-
 				//if no else and is last go to end
 				if (hasElse == false && pos == (this->branches->size()-1))
-					context->JumpFalse(("ifstatementend_"+uuid).c_str());
+					ii->condition->CompileCondition(context, ("ifstatementend_"+uuid).c_str());
 				else
-					context->JumpFalse((bname+"I").c_str());
+					ii->condition->CompileCondition(context, (bname+"I").c_str());
 
 				ii->block->Compile(context);
 
@@ -1012,7 +1117,13 @@ namespace Jet
 			context->Line(token.filename, token.line);
 
 			if (right)
+			{
 				right->Compile(context);
+
+				//nothing is left to do in this function after the call, so the callee can have its frame
+				if (dynamic_cast<CallExpression*>(right))
+					context->TailCall();
+			}
 			else
 				context->Null();//bad value to prevent use
 
@@ -0,0 +1,299 @@
+#include "GCHeap.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace Jet;
+
+GCHeap::GCHeap()
+{
+	this->used = 0;
+	this->freed = 0;
+	this->keep = 0;
+	this->keepdata = 0;
+	this->next = 0;
+	this->generation = 0;
+	this->quit = false;
+	this->hold = false;
+	for (auto& kind: this->classes)
+		for (auto& sc: kind)
+			sc.current = 0;
+	this->BeginWalk(false);
+}
+
+GCHeap::~GCHeap()
+{
+	this->SetBackgroundSweep(false);
+
+	for (auto& kind: this->classes)
+		for (auto& sc: kind)
+			for (auto page: sc.pages)
+				FreePage(page);
+
+	for (auto page: this->large)
+		FreePage(page);
+}
+
+void* GCHeap::Allocate(GCKind kind, size_t size)
+{
+	GCPage* page;
+	if (size > JET_GC_MAX_SMALL)
+	{
+		page = NewPage(kind, (unsigned int)size, 1);
+		this->large.push_back(page);
+	}
+	else
+	{
+		SizeClass& sc = this->classes[(int)kind][(size+15)/16 - 1];
+		for (;;)
+		{
+			if (sc.current == sc.pages.size())
+			{
+				unsigned int cellsize = (unsigned int)((size+15)/16)*16;
+				sc.pages.push_back(NewPage(kind, cellsize, JET_GC_PAGE_SIZE/cellsize));
+			}
+
+			page = sc.pages[sc.current];
+			if (page->state.load(std::memory_order_acquire) != GCPage::Swept && (this->hold || this->Claim(page) == false))
+			{
+				sc.current++;
+				continue;
+			}
+			if (page->free || page->bump < page->cells)
+				break;
+			sc.current++;
+		}
+	}
+
+	void* cell;
+	unsigned int i;
+	if (page->free)
+	{
+		cell = page->free;
+		page->free = *(void**)cell;
+		i = (unsigned int)(((char*)cell - page->data)/page->cellsize);
+	}
+	else
+	{
+		i = page->bump++;
+		cell = page->Cell(i);
+	}
+	page->allocated[i/32] |= 1u << (i%32);
+	page->live++;
+	this->used += page->cellsize;
+
+	YoungCell young = { page, i };
+	this->nursery.push_back(young);
+	return cell;
+}
+
+void GCHeap::Release(bool young)
+{
+	for (auto& kind: this->classes)
+	{
+		for (auto& sc: kind)
+		{
+			//pages before the current one may have free cells now
+			sc.current = 0;
+			if (young)
+				continue;
+
+			//empty pages are given back, apart from the first so the class doesnt churn
+			//only after full sweeps, young ones happen too often for that
+			unsigned int kept = 0;
+			for (unsigned int i = 0; i < sc.pages.size(); i++)
+			{
+				GCPage* page = sc.pages[i];
+				if (page->live || kept == 0)
+				{
+					//an empty page goes back to bump allocating
+					if (page->live == 0)
+					{
+						page->free = 0;
+						page->bump = 0;
+					}
+					sc.pages[kept++] = page;
+				}
+				else
+					FreePage(page);
+			}
+			sc.pages.resize(kept);
+		}
+	}
+
+	for (unsigned int i = 0; i < this->large.size(); )
+	{
+		if (this->large[i]->live == 0)
+		{
+			FreePage(this->large[i]);
+			this->large[i] = this->large.back();
+			this->large.pop_back();
+		}
+		else
+			i++;
+	}
+}
+
+void GCHeap::SetBackgroundSweep(bool background)
+{
+	if (this->sweeper.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> l(this->deferlock);
+			this->quit = true;
+		}
+		this->wake.notify_one();
+		this->sweeper.join();
+		this->quit = false;
+	}
+
+	if (background)
+		this->sweeper = std::thread(&GCHeap::Background, this);
+}
+
+void GCHeap::DeferSweep(GCKind from)
+{
+	this->cursor.end = (unsigned int)from;
+
+	std::lock_guard<std::mutex> l(this->deferlock);
+	for (unsigned int k = (unsigned int)from; k < (unsigned int)GCKind::Count; k++)
+	{
+		for (auto& sc: this->classes[k])
+		{
+			for (auto page: sc.pages)
+			{
+				page->state = GCPage::Unswept;
+				this->deferred.push_back(page);
+			}
+		}
+	}
+	for (auto page: this->large)
+	{
+		if (page->kind >= from)
+		{
+			page->state = GCPage::Unswept;
+			this->deferred.push_back(page);
+		}
+	}
+	this->next = 0;
+	this->hold = true;
+}
+
+void GCHeap::ReleaseDeferred()
+{
+	{
+		std::lock_guard<std::mutex> l(this->deferlock);
+		this->hold = false;
+		this->generation++;
+	}
+	this->wake.notify_one();
+}
+
+bool GCHeap::SweepDeferred(size_t& work)
+{
+	if (this->deferred.empty())
+		return true;
+
+	while (work > 0)
+	{
+		size_t i = this->next++;
+		if (i >= this->deferred.size())
+		{
+			//every page has been claimed, wait for the background sweeper to finish the ones it has
+			std::lock_guard<std::mutex> l(this->deferlock);
+			this->deferred.clear();
+			this->used -= this->freed.exchange(0);
+			this->Release(false);
+			return true;
+		}
+
+		GCPage* page = this->deferred[i];
+		this->Claim(page);
+		work -= std::min(work, (size_t)page->bump + 1);
+	}
+	return false;
+}
+
+bool GCHeap::Claim(GCPage* page)
+{
+	int state = GCPage::Unswept;
+	if (page->state.compare_exchange_strong(state, GCPage::Sweeping, std::memory_order_acq_rel) == false)
+		return state == GCPage::Swept;
+
+	this->SweepPage(page);
+	page->state.store(GCPage::Swept, std::memory_order_release);
+	return true;
+}
+
+void GCHeap::SweepPage(GCPage* page)
+{
+	size_t bytes = 0;
+	for (unsigned int w = 0; w*32 < page->bump; w++)
+	{
+		unsigned int bits = page->allocated[w];
+		for (unsigned int b = 0; bits; b++, bits >>= 1)
+		{
+			if ((bits & 1) == 0)
+				continue;
+
+			unsigned int i = w*32 + b;
+			void* cell = page->Cell(i);
+			if (this->keep(this->keepdata, page->kind, cell) == false)
+			{
+				page->allocated[w] &= ~(1u << b);
+				*(void**)cell = page->free;
+				page->free = cell;
+				page->live--;
+				bytes += page->cellsize;
+			}
+		}
+	}
+
+	//an empty page goes back to bump allocating
+	if (page->live == 0)
+	{
+		page->free = 0;
+		page->bump = 0;
+	}
+	this->freed += bytes;
+}
+
+void GCHeap::Background()
+{
+	unsigned int seen = 0;
+	std::unique_lock<std::mutex> l(this->deferlock);
+	for (;;)
+	{
+		this->wake.wait(l, [this, &seen] { return this->quit || this->generation != seen; });
+		if (this->quit)
+			return;
+		seen = this->generation;
+
+		//the lock is held the whole time so the pages arent cleared out from under it
+		for (size_t i; (i = this->next++) < this->deferred.size(); )
+			this->Claim(this->deferred[i]);
+	}
+}
+
+GCPage* GCHeap::NewPage(GCKind kind, unsigned int cellsize, unsigned int cells)
+{
+	GCPage* page = new GCPage;
+	page->kind = kind;
+	page->cellsize = cellsize;
+	page->cells = cells;
+	page->bump = 0;
+	page->live = 0;
+	page->free = 0;
+	page->state = GCPage::Swept;
+	page->data = new char[cellsize*cells];
+	page->allocated = new unsigned int[(cells+31)/32];
+	memset(page->allocated, 0, sizeof(unsigned int)*((cells+31)/32));
+	return page;
+}
+
+void GCHeap::FreePage(GCPage* page)
+{
+	delete[] page->data;
+	delete[] page->allocated;
+	delete page;
+}
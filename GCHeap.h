@@ -0,0 +1,268 @@
+#ifndef _JET_GC_HEAP_HEADER
+#define _JET_GC_HEAP_HEADER
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define JET_GC_PAGE_SIZE 65536//bytes of cells in each page
+#define JET_GC_MAX_SMALL 512//allocations bigger than this get a page to themselves
+
+namespace Jet
+{
+	//what a cell holds, so the collector knows how to destroy it
+	//sweeping goes in this order, so userdata finalizers still see the objects they reference
+	//userdata are always swept first, the other kinds can be left for later or another thread
+	enum class GCKind : unsigned char
+	{
+		Userdata,
+		Object,
+		Array,
+		Closure,
+		Upvalue,
+		String,
+
+		Count
+	};
+
+	//a block of equal sized cells that all hold the same kind of object
+	struct GCPage
+	{
+		GCKind kind;
+		unsigned int cellsize;
+		unsigned int cells;
+		unsigned int bump;//cells from here on have never been handed out
+		unsigned int live;
+		void* free;//freed cells, linked through their first word
+		char* data;
+		unsigned int* allocated;//a bit for each cell that holds an object
+
+		//pages with sweeping left to do cant be allocated from until whoever claims them sweeps them
+		enum
+		{
+			Swept,
+			Unswept,
+			Sweeping,
+		};
+		std::atomic<int> state;
+
+		void* Cell(unsigned int i)
+		{
+			return this->data + i*this->cellsize;
+		}
+	};
+
+	//the memory all garbage collected objects live in
+	//pages are split up by kind and size class, sizes are rounded up to a multiple of 16 bytes
+	//new pages are bump allocated, once cells are freed they are reused from the page's free list
+	//mark bits stay in the objects themselves, the heap only tracks which cells are in use
+	//cells allocated since the last sweep are the nursery, they can be swept on their own
+	//major sweeps only go through userdata right away, the rest of the pages are deferred
+	//once the userdata are done they get swept when an allocation gets to them, by the background sweeper or before the next collection
+	class GCHeap
+	{
+		struct YoungCell
+		{
+			GCPage* page;
+			unsigned int index;
+		};
+		std::vector<YoungCell> nursery;
+
+		struct SizeClass
+		{
+			std::vector<GCPage*> pages;
+			unsigned int current;//the page allocations are coming from, earlier ones are full
+		};
+		SizeClass classes[(int)GCKind::Count][JET_GC_MAX_SMALL/16];
+		std::vector<GCPage*> large;//one cell each
+		size_t used;//bytes in cells holding objects
+		std::atomic<size_t> freed;//bytes freed by deferred sweeping that havent been taken off used yet
+
+		//says if a cell is still alive, destroying what is in it if it isnt, used for deferred sweeping
+		typedef bool (*Keep)(void* data, GCKind kind, void* cell);
+		Keep keep;
+		void* keepdata;
+
+		std::vector<GCPage*> deferred;//pages left to sweep from the last major collection
+		std::atomic<size_t> next;//the next of those to claim
+		std::mutex deferlock;//held by the background sweeper while it is going through them
+		std::condition_variable wake;
+		std::thread sweeper;
+		unsigned int generation;//bumped each time deferred pages are released
+		bool quit;
+		bool hold;//deferred pages cant be swept until they are released
+
+		struct WalkCursor
+		{
+			bool young;
+			unsigned int kind, sizeclass, page, cell;
+			unsigned int end;//kinds from here on arent walked
+			unsigned int nursery, nurseryend;//the part of the nursery that was there when the walk began
+			bool rest;//young walks go through the nursery twice, userdata first and then everything else
+		} cursor;
+
+	public:
+		GCHeap();
+		~GCHeap();
+
+		//returns uninitialized memory for an object of the kind
+		void* Allocate(GCKind kind, size_t size);
+
+		//sets what decides if cells are alive when sweeping deferred pages
+		void SetKeep(Keep keep, void* data)
+		{
+			this->keep = keep;
+			this->keepdata = data;
+		}
+
+		//sweeps deferred pages on a thread of its own, for kinds without finalizers that only free memory
+		void SetBackgroundSweep(bool background);
+
+		//sweeping is a walk over the cells that can be done a bit at a time
+		//it covers every cell, or with young just the nursery, as it was when the walk began
+		void BeginWalk(bool young)
+		{
+			this->cursor.young = young;
+			this->cursor.kind = this->cursor.sizeclass = this->cursor.page = this->cursor.cell = 0;
+			this->cursor.end = (unsigned int)GCKind::Count;
+			this->cursor.nursery = 0;
+			this->cursor.nurseryend = (unsigned int)this->nursery.size();
+			this->cursor.rest = false;
+		}
+
+		//calls keep(kind, cell) on the next cells of the walk, cells it returns false for are freed
+		//keep has to destroy the objects it lets go of
+		//at most work cells are visited and work is lowered by that many, returns true once the walk is done
+		template<class T>
+		bool Walk(T& keep, size_t& work)
+		{
+			if (this->cursor.young)
+			{
+				//userdata go first like they do in full walks, so their finalizers see what they reference
+				for (;;)
+				{
+					for (; this->cursor.nursery < this->cursor.nurseryend; work--)
+					{
+						if (work == 0)
+							return false;
+
+						YoungCell young = this->nursery[this->cursor.nursery++];
+						if ((young.page->kind == GCKind::Userdata) == this->cursor.rest)
+							continue;
+						if (keep(young.page->kind, young.page->Cell(young.index)) == false)
+							this->Free(young.page, young.index);
+					}
+					if (this->cursor.rest)
+						return true;
+					this->cursor.rest = true;
+					this->cursor.nursery = 0;
+				}
+			}
+
+			//each kind's size classes and then its large pages, the last "size class" is the large pages
+			const unsigned int largeclass = JET_GC_MAX_SMALL/16;
+			WalkCursor& c = this->cursor;
+			while (c.kind < c.end)
+			{
+				std::vector<GCPage*>& pages = c.sizeclass < largeclass ? this->classes[c.kind][c.sizeclass].pages : this->large;
+				if (c.page >= pages.size())
+				{
+					c.page = 0;
+					if (++c.sizeclass > largeclass)
+					{
+						c.sizeclass = 0;
+						c.kind++;
+					}
+					continue;
+				}
+
+				GCPage* page = pages[c.page];
+				if ((unsigned int)page->kind == c.kind)
+				{
+					while (c.cell < page->bump)
+					{
+						unsigned int bits = page->allocated[c.cell/32] >> (c.cell%32);
+						if (bits == 0)
+						{
+							c.cell = (c.cell/32 + 1)*32;
+							continue;
+						}
+						if (work == 0)
+							return false;
+
+						unsigned int i = c.cell++;
+						if ((bits & 1) == 0)
+							continue;
+
+						work--;
+						if (keep(page->kind, page->Cell(i)) == false)
+							this->Free(page, i);
+					}
+				}
+				c.cell = 0;
+				c.page++;
+			}
+			return true;
+		}
+
+		//finishes a sweep, calls f(kind, cell) on the cells allocated since BeginWalk
+		//those stay in the nursery, everything allocated before leaves it and empty pages are given back
+		template<class T>
+		void EndWalk(T f)
+		{
+			for (size_t i = this->cursor.nurseryend; i < this->nursery.size(); i++)
+				f(this->nursery[i].page->kind, this->nursery[i].page->Cell(this->nursery[i].index));
+			this->nursery.erase(this->nursery.begin(), this->nursery.begin() + this->cursor.nurseryend);
+			this->cursor.nurseryend = 0;
+
+			this->Release(this->cursor.young || this->deferred.size());
+		}
+
+		//leaves the pages of the kind and the ones after it out of a full walk, they are swept later
+		//until ReleaseDeferred they are held, allocation skips them and nothing sweeps them
+		//that way finalizers run by the walk still see everything they reference
+		void DeferSweep(GCKind from);
+
+		//lets allocation and the background sweeper start on the deferred pages
+		void ReleaseDeferred();
+
+		//sweeps deferred pages on this thread, lowering work by about the number of cells in them
+		//returns true once all of them are swept
+		bool SweepDeferred(size_t& work);
+
+		size_t size() const
+		{
+			return this->used - this->freed;
+		}
+
+		//the number of cells allocated since the last sweep
+		size_t young() const
+		{
+			return this->nursery.size();
+		}
+
+	private:
+		void Free(GCPage* page, unsigned int i)
+		{
+			void* cell = page->Cell(i);
+			page->allocated[i/32] &= ~(1u << (i%32));
+			*(void**)cell = page->free;
+			page->free = cell;
+			page->live--;
+			this->used -= page->cellsize;
+		}
+
+		void Release(bool young);
+
+		//sweeps the page if it has yet to be, returns false if another thread is on it
+		bool Claim(GCPage* page);
+		void SweepPage(GCPage* page);
+		void Background();
+
+		static GCPage* NewPage(GCKind kind, unsigned int cellsize, unsigned int cells);
+		static void FreePage(GCPage* page);
+	};
+}
+#endif
@@ -0,0 +1,216 @@
+#include "GCMarker.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace Jet;
+
+//sets a grey flag, returns true if this thread was the one that set it
+static bool TryGrey(bool* grey)
+{
+#ifdef _MSC_VER
+	if (*(volatile bool*)grey)
+		return false;
+	return _InterlockedExchange8((volatile char*)grey, 1) == 0;
+#else
+	if (__atomic_load_n(grey, __ATOMIC_RELAXED))
+		return false;
+	return __atomic_exchange_n(grey, true, __ATOMIC_ACQ_REL) == false;
+#endif
+}
+
+GCMarker::GCMarker()
+{
+	this->generation = 0;
+	this->finished = 0;
+	this->quit = false;
+	this->idle = 0;
+	this->work = 0;
+	this->SetThreads(1);
+}
+
+GCMarker::~GCMarker()
+{
+	this->SetThreads(0);
+}
+
+void GCMarker::SetThreads(unsigned int threads)
+{
+	//stop the old threads
+	{
+		std::lock_guard<std::mutex> l(this->lock);
+		this->quit = true;
+	}
+	this->start.notify_all();
+	for (auto& t: this->threads)
+		t.join();
+	this->threads.clear();
+	this->quit = false;
+
+	for (auto w: this->workers)
+		delete w;
+	this->workers.clear();
+
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		this->workers.push_back(new Worker);
+		this->workers.back()->size = 0;
+	}
+	for (unsigned int i = 1; i < threads; i++)
+		this->threads.push_back(std::thread(&GCMarker::Loop, this, i));
+}
+
+void GCMarker::Loop(unsigned int id)
+{
+	unsigned int seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> l(this->lock);
+			this->start.wait(l, [this, &seen] { return this->quit || this->generation != seen; });
+			if (this->quit)
+				return;
+			seen = this->generation;
+		}
+
+		this->Run(id);
+
+		{
+			std::lock_guard<std::mutex> l(this->lock);
+			this->finished++;
+		}
+		this->done.notify_one();
+	}
+}
+
+size_t GCMarker::Mark(std::vector<Value>& greys)
+{
+	//deal the greys out to the workers
+	for (unsigned int i = 0; i < greys.size(); i++)
+		this->workers[i%this->workers.size()]->shared.push_back(greys[i]);
+	for (auto w: this->workers)
+		w->size = w->shared.size();
+	greys.clear();
+
+	this->idle = 0;
+	this->work = 0;
+	{
+		std::lock_guard<std::mutex> l(this->lock);
+		this->finished = 0;
+		this->generation++;
+	}
+	this->start.notify_all();
+
+	this->Run(0);
+
+	std::unique_lock<std::mutex> l(this->lock);
+	this->done.wait(l, [this] { return this->finished == this->threads.size(); });
+	return this->work;
+}
+
+void GCMarker::Run(unsigned int id)
+{
+	std::vector<Value> local;
+	size_t work = 0;
+	auto push = [&local](const Value& v)
+	{
+		if (v.type() > ValueType::String)
+		{
+			if (TryGrey(&v._object()->grey))
+				local.push_back(v);
+		}
+		else if (v.type() == ValueType::String && v.collected())
+		{
+			//strings have nothing to traverse, whoever greys one marks it too
+			auto str = _JetGCString::Get(v._string());
+			if (TryGrey(&str->grey))
+				str->mark = true;
+		}
+	};
+
+	for (;;)
+	{
+		if (local.empty() && this->Take(id, local) == false)
+		{
+			//out of work, wait until someone shares more or everyone is out
+			this->idle++;
+			for (;;)
+			{
+				if (this->idle == this->workers.size())
+				{
+					this->work += work;
+					return;
+				}
+
+				bool found = false;
+				for (auto w: this->workers)
+					found |= w->size > 0;
+				if (found)
+				{
+					this->idle--;
+					break;
+				}
+				std::this_thread::yield();
+			}
+			continue;
+		}
+
+		Value obj = local.back();
+		local.pop_back();
+		work += Traverse(obj, push);
+
+		if (local.size() > JET_GC_SHARE && this->workers[id]->size == 0)
+			this->Share(id, local);
+	}
+}
+
+bool GCMarker::Take(unsigned int id, std::vector<Value>& local)
+{
+	//own work first, from the back where it was just put
+	Worker* own = this->workers[id];
+	if (own->size)
+	{
+		std::lock_guard<std::mutex> l(own->lock);
+		for (size_t j = 0; j < JET_GC_SHARE && own->shared.size(); j++)
+		{
+			local.push_back(own->shared.back());
+			own->shared.pop_back();
+		}
+		own->size = own->shared.size();
+		if (local.size())
+			return true;
+	}
+
+	//then steal half of someone else's from the front
+	for (unsigned int i = 1; i < this->workers.size(); i++)
+	{
+		Worker* other = this->workers[(id + i)%this->workers.size()];
+		if (other->size == 0)
+			continue;
+
+		std::lock_guard<std::mutex> l(other->lock);
+		size_t n = (other->shared.size() + 1)/2;
+		for (size_t j = 0; j < n; j++)
+		{
+			local.push_back(other->shared.front());
+			other->shared.pop_front();
+		}
+		other->size = other->shared.size();
+		if (n)
+			return true;
+	}
+	return false;
+}
+
+void GCMarker::Share(unsigned int id, std::vector<Value>& local)
+{
+	//give away the oldest half, those tend to lead to the most work
+	Worker* own = this->workers[id];
+	size_t n = local.size()/2;
+	std::lock_guard<std::mutex> l(own->lock);
+	for (size_t i = 0; i < n; i++)
+		own->shared.push_back(local[i]);
+	own->size = own->shared.size();
+	local.erase(local.begin(), local.begin() + n);
+}
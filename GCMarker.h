@@ -0,0 +1,133 @@
+#ifndef _JET_GC_MARKER_HEADER
+#define _JET_GC_MARKER_HEADER
+
+#include "JetObject.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#define JET_GC_SHARE 64//workers with more greys than this give some to the others
+#define JET_GC_PARALLEL_MIN (4*1024*1024)//heaps smaller than this are always marked on one thread
+
+namespace Jet
+{
+	//traverses the object graph for the collector, on one thread or with a pool of them
+	//each worker has its own grey stack and a deque it hands work out from, idle workers steal from the front of them
+	//whichever worker sets an object's grey flag first is the one that traverses it
+	//the script is never running while it marks, so nothing changes under the workers
+	class GCMarker
+	{
+		struct Worker
+		{
+			std::mutex lock;
+			std::deque<Value> shared;
+			std::atomic<size_t> size;//of shared, so it can be checked without taking the lock
+		};
+		std::vector<Worker*> workers;//the first one is the thread that called Mark
+		std::vector<std::thread> threads;
+
+		std::mutex lock;
+		std::condition_variable start, done;
+		unsigned int generation;//bumped to start the threads on a mark
+		unsigned int finished;//threads done with the current mark
+		bool quit;
+		std::atomic<unsigned int> idle;
+		std::atomic<size_t> work;//what Traverse returned, summed over the workers
+
+	public:
+		GCMarker();
+		~GCMarker();
+
+		//the number of threads that mark, counting the one the collector runs on
+		void SetThreads(unsigned int threads);
+		unsigned int GetThreads() const
+		{
+			return (unsigned int)this->workers.size();
+		}
+
+		//marks everything reachable from the greys, using all of the threads
+		//returns the work that was, like Traverse does
+		size_t Mark(std::vector<Value>& greys);
+
+		//sets the mark of a grey object and calls push(value) on what it references that might still be white
+		//returns about how much work that was, for step budgets
+		template<class T>
+		static size_t Traverse(const Value& obj, T& push)
+		{
+			switch (obj.type())
+			{
+			case ValueType::Object:
+				{
+					auto prototype = obj._object()->prototype;
+					if (prototype)
+						push(Value(prototype));
+
+					//keys can be collected strings too
+					obj._object()->mark = true;
+					for (auto ii: *obj._object()->ptr)
+					{
+						push(ii.first);
+						push(ii.second);
+					}
+					return 1 + obj._object()->ptr->size();
+				}
+			case ValueType::Array:
+				{
+					obj._array()->mark = true;
+					for (auto ii: *obj._array()->ptr)
+						push(ii);
+					return 1 + obj._array()->ptr->size();
+				}
+			case ValueType::Function:
+				{
+					obj._function()->mark = true;
+					for (int i = 0; i < obj._function()->numupvals; i++)
+						push(Value(obj._function()->upvals[i]));
+					return 1 + obj._function()->numupvals;
+				}
+			case ValueType::Capture:
+				{
+					//open ones point at the stack, which is marked anyway
+					obj._upvalue()->mark = true;
+					push(*obj._upvalue()->v);
+					return 1;
+				}
+			case ValueType::Userdata:
+				{
+					obj._userdata()->mark = true;
+
+					//userdata prototypes usually arent in the heap, so their flags never get cleared
+					//what they hold is traversed every time instead of going by its flags
+					//that marks it without greying it, which is enough for the sweep to keep it
+					size_t work = 1;
+					auto prototype = obj._userdata()->ptr.second;
+					if (prototype)
+					{
+						prototype->mark = true;
+						for (auto ii: *prototype->ptr)
+						{
+							if (ii.second.type() > ValueType::String)
+								work += Traverse(ii.second, push);
+							else
+								push(ii.second);
+						}
+					}
+					return work;
+				}
+			default:
+				return 1;
+			}
+		}
+
+	private:
+		void Run(unsigned int id);
+		void Loop(unsigned int id);
+		bool Take(unsigned int id, std::vector<Value>& local);
+		void Share(unsigned int id, std::vector<Value>& local);
+	};
+}
+#endif
@@ -1,85 +1,205 @@
 #include "GarbageCollector.h"
 #include "JetContext.h"
 
+#include <chrono>
+#include <cstring>
+
 using namespace Jet;
 
+static bool Keep(void* context, GCKind kind, void* cell);
+
 GarbageCollector::GarbageCollector(JetContext* context) : context(context)
 {
-	this->allocationCounter = 1;//messes up if these start at 0
-	this->collectionCounter = 1;
+	this->phase = GCPhase::Idle;
+	this->major = false;
+	this->allocated = 0;
+	this->external = 0;
+	this->marked = 0;
+	this->live = 0;
+	this->measure = false;
+	this->heap.SetKeep(Keep, context);
 }
 
-void GarbageCollector::Cleanup()
+//everything in the heap starts with these
+struct GCFlags
+{
+	bool mark;
+	bool grey;
+};
+
+//objects and arrays share a cell with their backing
+struct ObjectCell
 {
-	for (auto ii: this->userdata)
+	_JetObject object;
+	_JetObjectBacking backing;
+
+	ObjectCell(Shape* root) : backing(root)
 	{
-		if (ii->ptr.second)
-		{
-			Value ud = Value(ii, ii->ptr.second);
-			Value _gc = (*ii->ptr.second->ptr)["_gc"];
-			if (_gc.type == ValueType::NativeFunction)
-				_gc.func(this->context, &ud, 1);
-			//else if (_gc.type == ValueType::Function)
-			//todo
-			else if (_gc.type != ValueType::Null)
-				throw RuntimeException("Non Native _gc Hooks Not Implemented!");
-		}
-		delete ii;
+		this->object.ptr = &this->backing;
 	}
-	this->userdata.clear();
+};
 
-	for (auto ii: this->arrays)
+struct ArrayCell
+{
+	_JetArray array;
+	_JetArrayBacking backing;
+
+	ArrayCell(size_t size) : backing(size)
 	{
-		delete ii->ptr;
-		delete ii;
+		this->array.ptr = &this->backing;
 	}
-	this->arrays.clear();
+};
+
+_JetObject* GarbageCollector::NewObject(Shape* root)
+{
+	auto cell = new (this->heap.Allocate(GCKind::Object, sizeof(ObjectCell))) ObjectCell(root);
+	this->allocated += sizeof(ObjectCell);
+	cell->object.grey = cell->object.mark = this->phase >= GCPhase::Mark;
+	return &cell->object;
+}
+
+_JetArray* GarbageCollector::NewArray(size_t size)
+{
+	auto cell = new (this->heap.Allocate(GCKind::Array, sizeof(ArrayCell))) ArrayCell(size);
+	this->allocated += sizeof(ArrayCell);
+	this->Account(size*sizeof(Value));
+	cell->array.grey = cell->array.mark = this->phase >= GCPhase::Mark;
+	return &cell->array;
+}
+
+_JetUserdata* GarbageCollector::NewUserdata(void* data, _JetObject* prototype)
+{
+	auto ud = new (this->heap.Allocate(GCKind::Userdata, sizeof(_JetUserdata))) _JetUserdata(std::pair<void*, _JetObject*>(data, prototype));
+	this->allocated += sizeof(_JetUserdata);
+	ud->grey = ud->mark = this->phase >= GCPhase::Mark;
+
+	//write barrier, the prototype could be young
+	if (prototype)
+		this->Remember(Value(ud));
+	return ud;
+}
 
-	for (auto ii: this->objects)
+Closure* GarbageCollector::NewClosure(Function* prototype)
+{
+	unsigned int upvals = prototype->upvals;
+	size_t size = sizeof(Closure) + upvals*sizeof(Upvalue*);
+	auto closure = (Closure*)this->heap.Allocate(GCKind::Closure, size);
+	this->allocated += size;
+	closure->grey = closure->mark = this->phase >= GCPhase::Mark;
+	closure->numupvals = upvals;
+	closure->prototype = prototype;
+	closure->upvals = upvals ? (Upvalue**)(closure+1) : 0;
+	return closure;
+}
+
+Upvalue* GarbageCollector::NewUpvalue(Value* local)
+{
+	auto upvalue = (Upvalue*)this->heap.Allocate(GCKind::Upvalue, sizeof(Upvalue));
+	this->allocated += sizeof(Upvalue);
+	upvalue->grey = upvalue->mark = this->phase >= GCPhase::Mark;
+	upvalue->v = local;
+	upvalue->next = 0;
+	return upvalue;
+}
+
+_JetGCString* GarbageCollector::NewString(const char* data, size_t length)
+{
+	size_t size = sizeof(_JetGCString) + length;
+	auto str = (_JetGCString*)this->heap.Allocate(GCKind::String, size);
+	this->allocated += size;
+	str->grey = str->mark = this->phase >= GCPhase::Mark;
+	str->pinned = false;
+	str->length = (unsigned int)length;
+	memcpy(str->data, data, length);
+	str->data[length] = 0;
+	str->hash = HashFunction::Hash(str->data, length);
+	return str;
+}
+
+//calls the _gc function of a userdata's prototype before it is freed
+static void Finalize(JetContext* context, _JetUserdata* ud)
+{
+	if (ud->ptr.second)
 	{
-		delete ii->ptr;
-		delete ii;
+		Value v = Value(ud);
+		Value* _gc = ud->ptr.second->ptr->Find(Value("_gc"));
+		if (_gc == 0)
+			return;
+		if (_gc->type() == ValueType::NativeFunction)
+			_gc->func()(context, &v, 1);
+		//else if (_gc->type == ValueType::Function)
+		//todo
+		else if (_gc->type() != ValueType::Null)
+			throw RuntimeException("Non Native _gc Hooks Not Implemented!");
 	}
-	this->objects.clear();
+}
 
-	for (auto ii: this->strings)
+//destroys whatever is in a cell that is about to be freed
+static void Destroy(JetContext* context, GCKind kind, void* cell)
+{
+	switch (kind)
 	{
-		delete ii->ptr;
-		delete ii;
+	case GCKind::Userdata:
+		Finalize(context, (_JetUserdata*)cell);
+		((_JetUserdata*)cell)->~_JetUserdata();
+		break;
+	case GCKind::Object:
+		((ObjectCell*)cell)->~ObjectCell();
+		break;
+	case GCKind::Array:
+		((ArrayCell*)cell)->~ArrayCell();
+		break;
+	case GCKind::Closure:
+	case GCKind::Upvalue:
+	case GCKind::String:
+	default:
+		break;
 	}
-	this->strings.clear();
+}
+
+//survivors keep their marks, so they are old from now on
+//ones that are grey but not marked were written to after being marked
+//ones that are marked but not grey were traversed straight from a userdata prototype, see GCMarker::Traverse
+//so either flag says an object is alive, apart from strings that shapes hold on to
+static bool Keep(void* context, GCKind kind, void* cell)
+{
+	GCFlags* flags = (GCFlags*)cell;
+	if (flags->grey || flags->mark || (kind == GCKind::String && ((_JetGCString*)cell)->pinned))
+		return true;
 
-	for (auto ii: this->closures)
+	Destroy((JetContext*)context, kind, cell);
+	return false;
+}
+
+void GarbageCollector::Cleanup()
+{
+	//everything gets destroyed, deferred pages included, in the order userdata finalizers need
+	JetContext* context = this->context;
+	this->heap.SetBackgroundSweep(false);
+
+	size_t all = (size_t)-1;
+	auto destroy = [context](GCKind kind, void* cell) -> bool
 	{
-		if (ii->numupvals)
-			delete[] ii->upvals;
-		delete ii;
-	}
-	this->closures.clear();
+		Destroy(context, kind, cell);
+		return false;
+	};
+	this->heap.BeginWalk(false);
+	this->heap.Walk(destroy, all);
 }
 
-void GarbageCollector::Mark()
+void GarbageCollector::MarkRoots()
 {
-	//add more write barriers to detect when objects are removed and what not
 	//if flag is marked, then black
 	//if no flag and grey bit, then grey
 	//if no flag or grey bit, then white
+	//old objects are black and get skipped, unless a write barrier made them grey again
 
 	//push all reachable items onto grey stack
 	//this means globals
 	{
 		//StackProfile profile("Mark Globals as Grey");
 		for (int i = 0; i < context->vars.size(); i++)
-		{
-			if (context->vars[i].type > ValueType::NativeFunction)
-			{
-				if (/*vars[i]._object->mark == false && */context->vars[i]._object->grey == false)
-				{
-					context->vars[i]._object->grey = true;
-					this->greys.Push(context->vars[i]);
-				}
-			}
-		}
+			this->Grey(context->vars[i]);
 	}
 
 
@@ -87,16 +207,7 @@ void GarbageCollector::Mark()
 	{
 		//StackProfile prof("Make Stack Grey");
 		for (int i = 0; i < context->stack.size(); i++)
-		{
-			if (context->stack.mem[i].type > ValueType::NativeFunction)
-			{
-				if (context->stack.mem[i]._object->grey == false)
-				{
-					context->stack.mem[i]._object->grey = true;
-					this->greys.Push(context->stack.mem[i]);
-				}
-			}
-		}
+			this->Grey(context->stack.mem[i]);
 	}
 
 
@@ -109,7 +220,7 @@ void GarbageCollector::Mark()
 		if (context->curframe->grey == false)
 		{
 			context->curframe->grey = true;
-			this->greys.Push(Value(context->curframe));
+			this->greys.push_back(Value(context->curframe));
 		}
 
 		int sp = 0;
@@ -119,259 +230,168 @@ void GarbageCollector::Mark()
 			if (closure->grey == false)
 			{
 				closure->grey = true;
-				this->greys.Push(Value(closure));
+				this->greys.push_back(Value(closure));
 			}
 			int max = sp+closure->prototype->locals;
 			for (; sp < max; sp++)
-			{
-				if (context->localstack[sp].type > ValueType::NativeFunction)
-				{
-					if (context->localstack[sp]._object->grey == false)
-					{
-						context->localstack[sp]._object->grey = true;
-						this->greys.Push(context->localstack[sp]);
-					}
-				}
-			}
+				this->Grey(context->localstack[sp]);
 		}
 
 		//mark curframe locals
 		int max = sp+context->curframe->prototype->locals;
 		for (; sp < max; sp++)
-		{
-			if (context->localstack[sp].type > ValueType::NativeFunction)
-			{
-				if (context->localstack[sp]._object->grey == false)
-				{
-					context->localstack[sp]._object->grey = true;
-					this->greys.Push(context->localstack[sp]);
-				}
-			}
-		}
+			this->Grey(context->localstack[sp]);
 	}
 
+	//open upvalues are still in the list even if no closure leads to them any more
+	for (auto upvalue = context->openupvals; upvalue; upvalue = upvalue->next)
+		this->Grey(Value(upvalue));
+}
+
+void GarbageCollector::Propagate(size_t& work)
+{
+	//old objects that were written to may point at young ones
+	this->greys.insert(this->greys.end(), this->remembered.begin(), this->remembered.end());
+	this->remembered.clear();
 
+	//whole traversals of big heaps are split between the marker's threads
+	if (work == (size_t)-1 && this->major && this->marker.GetThreads() > 1 && this->heap.size() >= JET_GC_PARALLEL_MIN)
 	{
-		//StackProfile prof("Traverse Greys");
-		while(this->greys.size() > 0)
-		{
-			//traverse the object
-			auto obj = this->greys.Pop();
-			switch (obj.type)
-			{
-			case ValueType::Object:
-				{
-					if (obj.prototype && obj.prototype->grey == false)
-					{
-						obj.prototype->grey = true;
-						obj.prototype->mark = true;
-
-						for (auto ii: *obj.prototype->ptr)
-						{
-							if (ii.second.type > ValueType::NativeFunction)
-							{
-								ii.second._object->grey = true;
-								greys.Push(ii.second);
-							}
-						}
-					}
-
-					obj._object->mark = true;
-					for (auto ii: *obj._object->ptr)
-					{
-						if (ii.second.type > ValueType::NativeFunction && ii.second._object->grey == false)
-						{
-							ii.second._object->grey = true;
-							greys.Push(ii.second);
-						}
-					}
-					break;
-				}
-			case ValueType::Array:
-				{
-					obj._array->mark = true;
-
-					for (auto ii: *obj._array->ptr)
-					{
-						if (ii.type > ValueType::NativeFunction && ii._object->grey == false)
-						{
-							ii._object->grey = true;
-							greys.Push(ii);
-						}
-					}
-
-					break;
-				}
-			case ValueType::String:
-				{
-					break;
-				}
-			case ValueType::Function:
-				{
-					obj._function->mark = true;
-					//printf("Function Marked\n");
-					if (obj._function->prev && obj._function->prev->grey == false)
-					{
-						obj._function->prev->grey = true;
-						greys.Push(Value(obj._function->prev));
-					}
-
-					if (obj._function->closed)
-					{
-						for (int i = 0; i < obj._function->numupvals; i++)
-						{
-							if (obj._function->cupvals[i].type > ValueType::NativeFunction)
-							{
-								if (obj._function->cupvals[i]._object->grey == false)
-								{
-									obj._function->cupvals[i]._object->grey = true;
-									greys.Push(obj._function->cupvals[i]);
-								}
-							}
-						}
-					}
-					break;
-				}
-			case ValueType::Userdata:
-				{
-					obj._userdata->mark = true;
+		this->marked += this->marker.Mark(this->greys);
+		return;
+	}
 
-					if (obj.prototype)
-					{
-						obj.prototype->mark = true;
+	auto push = [this](const Value& v)
+	{
+		this->Grey(v);
+	};
 
-						for (auto ii: *obj.prototype->ptr)
-							greys.Push(ii.second);
-					}
-					break;
-				}
-			}
-		}
+	//StackProfile prof("Traverse Greys");
+	while (this->greys.size() > 0 && work > 0)
+	{
+		//traverse the object
+		auto obj = this->greys.back();
+		this->greys.pop_back();
+		size_t cost = GCMarker::Traverse(obj, push);
+		work -= std::min(work, cost);
+		this->marked += cost;
 	}
 }
 
-void GarbageCollector::Sweep()
+bool GarbageCollector::Work(size_t work)
 {
-	bool nextIncremental = ((this->collectionCounter+1)%GC_STEPS)!=0;
-	/*if (this->collectionCounter % GC_STEPS == 0)
-	printf("Full Collection!\n");
-	else
-	printf("Incremental Collection!\n");*/
-
-	/* SWEEPING SECTION */
-
-
-	//this must all be done when sweeping!!!!!!!
-
-	//process stack variables, stack vars are ALWAYS grey
-
-	//finally sweep through
-	//sweep and free all whites and make all blacks white
-	//iterate through all gc values
-
-	//mark stack variables and globals
+	JetContext* context = this->context;
+	switch (this->phase)
 	{
-		//StackProfile prof("Sweep");
-		auto olist = std::move(this->objects);
-		this->objects.clear();
-		for (auto ii: olist)
+	case GCPhase::Idle:
 		{
-			if (ii->mark)
-			{
-				if (nextIncremental == false)
-				{
-					ii->mark = false;
-					ii->grey = false;
-				}
-				this->objects.push_back(ii);
-			}
-			else
+			//the last major collection has to be completely swept before starting another
+			if (this->heap.SweepDeferred(work) == false)
+				break;
+
+			//the heap is only as small as it gets once the garbage is all swept
+			if (this->measure)
 			{
-				delete ii->ptr;
-				delete ii;
+				this->live = this->Bytes();
+				this->measure = false;
 			}
-		}
 
-		auto alist = std::move(this->arrays);
-		this->arrays.clear();
-		for (auto ii: alist)
-		{
-			if (ii->mark)
+			//major once the heap has grown past what was left last time by the growth factor
+			size_t threshold = std::max(this->pacing.minheap, (size_t)(this->live*this->pacing.growth));
+			if (this->pacing.maxheap && threshold > this->pacing.maxheap)
+				threshold = this->pacing.maxheap;
+			this->major = this->Bytes() >= threshold;
+			this->marked = 0;
+			if (this->major)
 			{
-				if (nextIncremental == false)
-				{
-					ii->mark = false;
-					ii->grey = false;
-				}
-				this->arrays.push_back(ii);
+				this->phase = GCPhase::Clear;
+				this->heap.BeginWalk(false);
 			}
 			else
 			{
-				delete ii->ptr;
-				delete ii;
+				this->phase = GCPhase::Mark;
+				this->MarkRoots();
 			}
+			break;
 		}
-
-		auto clist = std::move(this->closures);
-		this->closures.clear();
-		for (auto ii: clist)
+	case GCPhase::Clear:
 		{
-			if (ii->mark)
+			//everything is young again and gets traversed
+			auto clear = [](GCKind kind, void* cell) -> bool
 			{
-				if (nextIncremental == false)
-				{
-					ii->mark = false;
-					ii->grey = false;
-				}
-				this->closures.push_back(ii);
-			}
-			else
+				((GCFlags*)cell)->mark = false;
+				((GCFlags*)cell)->grey = false;
+				return true;
+			};
+			if (this->heap.Walk(clear, work))
 			{
-				if (ii->numupvals)
-					delete[] ii->upvals;
-				delete ii;
+				this->remembered.clear();
+				this->phase = GCPhase::Mark;
+				this->MarkRoots();
 			}
+			break;
 		}
-
-		auto ulist = std::move(this->userdata);
-		this->userdata.clear();
-		for (auto ii: ulist)
+	case GCPhase::Mark:
 		{
-			if (ii->mark)
+			this->Propagate(work);
+			if (this->greys.size() == 0)
 			{
-				if (nextIncremental == false)
+				//the roots changed without barriers since they were marked, so do them again
+				//along with everything only they lead to, this is the only part that cant be split up
+				size_t all = (size_t)-1;
+				this->MarkRoots();
+				this->Propagate(all);
+
+				this->phase = GCPhase::Sweep;
+				this->heap.BeginWalk(this->major == false);
+				if (this->major)
 				{
-					ii->mark = false;
-					ii->grey = false;
+					//a major mark went over everything alive, which gives what it all holds outside the heap
+					//until the next one that only grows, by what gets allocated
+					this->external = this->marked*sizeof(Value);
+					this->measure = true;
+					this->heap.DeferSweep(GCKind::Object);
 				}
-				this->userdata.push_back(ii);
 			}
-			else
+			break;
+		}
+	case GCPhase::Sweep:
+		{
+			auto keep = [context](GCKind kind, void* cell) -> bool
 			{
-				if (ii->ptr.second)
+				return Keep(context, kind, cell);
+			};
+			if (this->heap.Walk(keep, work))
+			{
+				//the userdata finalizers are done, what they referenced can be swept now
+				if (this->major)
+					this->heap.ReleaseDeferred();
+
+				//objects allocated while sweeping were black so they wouldnt be freed, they are young now
+				this->heap.EndWalk([](GCKind kind, void* cell)
 				{
-					Value ud = Value(ii, ii->ptr.second);
-					Value _gc = (*ii->ptr.second->ptr)["_gc"];
-					if (_gc.type == ValueType::NativeFunction)
-						_gc.func(this->context, &ud, 1);
-					else if (_gc.type != ValueType::Null)
-						throw RuntimeException("Not Implemented!");
-				}
-				delete ii;
+					((GCFlags*)cell)->mark = false;
+					((GCFlags*)cell)->grey = false;
+				});
+				this->phase = GCPhase::Idle;
+				return true;
 			}
+			break;
 		}
 	}
+	return false;
+}
 
-	//Obviously, this approach doesn't work for a non-copying GC. But the main insights behind a generational GC can be abstracted:
-
-	//Minor collections only take care of newly allocated objects.
-	//Major collections deal with all objects, but are run much less often.
-
-	//The basic idea is to modify the sweep phase: 
-	//1. free the (unreachable) white objects, but don't flip the color of black objects before a minor collection. 
-	//2. The mark phase of the following minor collection then only traverses newly allocated blocks and objects written to (marked gray). 
-	//3. All other objects are assumed to be still reachable during a minor GC and are neither traversed, nor swept, nor are their marks changed (kept black). A regular sweep phase is used if a major collection is to follow.
-
+bool GarbageCollector::Step(unsigned int budget)
+{
+	auto start = std::chrono::steady_clock::now();
+	do
+	{
+		if (this->Work(JET_GC_STEP_WORK))
+			return true;
+	}
+	while (std::chrono::steady_clock::now() - start < std::chrono::microseconds(budget));
+	return false;
 }
 
 void GarbageCollector::Run()
@@ -382,13 +402,9 @@ void GarbageCollector::Run()
 	//QueryPerformanceFrequency( (LARGE_INTEGER *)&rate );
 	QueryPerformanceCounter( (LARGE_INTEGER *)&start );
 #endif
-	//mark all references in the grey stack
-	this->Mark();
-
-	//clear up dead memory
-	this->Sweep();
+	//finish the collection going on, if it is in the middle of one
+	while (this->Work((size_t)-1) == false);
 
-	this->collectionCounter++;//used to determine collection mode
 #ifdef JET_TIME_EXECUTION
 	QueryPerformanceCounter( (LARGE_INTEGER *)&end );
 
@@ -399,4 +415,4 @@ void GarbageCollector::Run()
 #endif
 	//this->StackTrace(curframe->prototype->ptr);
 	//printf("GC Complete: %d Greys, %d Globals, %d Stack\n%d Closures, %d Arrays, %d Objects, %d Userdata\n", this->greys.size(), this->vars.size(), 0, this->closures.size(), this->arrays.size(), this->objects.size(), this->userdata.size());
-}
\ No newline at end of file
+}
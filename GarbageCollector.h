@@ -3,86 +3,170 @@
 
 #include "Value.h"
 #include "VMStack.h"
+#include "GCHeap.h"
+#include "GCMarker.h"
 #include <vector>
 
+#define JET_GC_STEP_WORK 256//objects or cells done between looking at the time in a step
+
+//the default pacing, see GCPacing
+#define JET_GC_GROWTH 2.0
+#define JET_GC_MIN_HEAP (4*1024*1024)
+#define JET_GC_NURSERY (256*1024)
+
 namespace Jet
 {
 	class JetContext;
 
-	class GarbageCollector
+	//what the collector is in the middle of, collections go through these in order
+	enum class GCPhase
 	{
-		//finish moving stuff over to me
-		//must free with GCFree, pointer is a bit offset to leave room for the flag
-		template<class T> 
-		T* GCAllocate()
-		{
-#undef new
-			//need to call constructor
-			char* buf = new char[sizeof(T)+1];
-			this->gcObjects.push_back(buf);
-			new (buf+1) T();
-			return (T*)(buf+1);
-
-#ifdef _DEBUG
-#ifndef DBG_NEW      
-#define DBG_NEW new ( _NORMAL_BLOCK , __FILE__ , __LINE__ )     
-#define new DBG_NEW   
-#endif
-#endif
-		}
-
-		template<class T> 
-		T* GCAllocate2(unsigned int size)
-		{
-			return (T*)((new char[sizeof(T)+1])+1);
-		}
-
-		char* GCAllocate(unsigned int size)
-		{
-			//this leads to less indirection, and simplified cleanup
-			char* data = new char[size+1];//enough room for the flag
-			this->gcObjects.push_back(data);
-			return data+1;
-		}
+		Idle,
+		Clear,//major collections first clear every mark
+		Mark,
+		Sweep,
+	};
 
-		//need to call destructor first
-		template<class T>
-		void GCFree(T* data)
-		{
-			data->~T();
-			delete[] (((char*)data)-1);
-		}
+	//decides when the collector runs, by bytes allocated rather than by number of objects
+	//can be changed on a context at any time with JetContext::SetGCPacing
+	struct GCPacing
+	{
+		double growth;//a collection is major once the heap is this many times what was left after the last major one
+		size_t minheap;//collections are all minor while the heap is smaller than this
+		size_t maxheap;//bytes past which every collection is major and done at once, 0 for no limit
+		size_t nursery;//bytes allocated between collections, or between steps of an incremental one
+		unsigned int pause;//microseconds per step when collecting incrementally, 0 does whole collections at once
 
-		void GCFree(char* data)
+		GCPacing()
 		{
-			delete[] (data-1);
+			this->growth = JET_GC_GROWTH;
+			this->minheap = JET_GC_MIN_HEAP;
+			this->maxheap = 0;
+			this->nursery = JET_GC_NURSERY;
+			this->pause = 0;
 		}
+	};
 
+	//a generational mark and sweep collector that doesnt move anything
+	//objects that survive a collection stay marked, that is what makes them old
+	//minor collections only traverse young objects and old ones that were written to,
+	//which the write barriers remember, then sweep just the heap's nursery
+	//once the heap has grown enough since the last one, a major collection clears all marks and does everything
+	//collections can also be done incrementally in steps with the script running in between
+	//objects allocated while marking or sweeping start out black so they survive it
+	//roots arent guarded by the barriers, they are marked again when marking finishes
+	class GarbageCollector
+	{
 		JetContext* context;
 	public:
 		//garbage collector stuff
-		std::vector<_JetArray*> arrays;
-		std::vector<_JetObject*> objects;
-		std::vector<GCVal<char*>*> strings;
-		std::vector<_JetUserdata*> userdata;
+		GCHeap heap;//objects, arrays, userdata, closures and strings
+		GCMarker marker;//threads for marking in parallel
 
-		std::vector<Closure*> closures;
+		std::vector<Value> greys;//stack of grey objects for processing
+		std::vector<Value> remembered;//old objects written to since the last collection
 
-		std::vector<char*> gcObjects;//not used atm
+		GCPhase phase;
+		bool major;//if the collection going on is a major one
 
-		int allocationCounter;//used to determine when to run the GC
-		int collectionCounter;
-		VMStack<Value> greys;//stack of grey objects for processing
+		GCPacing pacing;
+		size_t allocated;//bytes allocated since the last collection or step
+		size_t external;//bytes held outside of the heap's cells, by array and object storage
+		size_t marked;//work done marking the collection going on, about the number of values traversed
+		size_t live;//bytes left after the last major collection
+		bool measure;//live is measured once the last major collection's deferred pages are swept
 
 		GarbageCollector(JetContext* context);
 		//~GarbageCollector(void);
 
 		void Cleanup();
 
+		//these allocate an object and what it holds together in one heap cell
+		_JetObject* NewObject(Shape* root);
+		_JetArray* NewArray(size_t size);
+		_JetUserdata* NewUserdata(void* data, _JetObject* prototype);
+		//the upvalue pointers follow the closure, they are left for the caller to fill in
+		Closure* NewClosure(Function* prototype);
+		//an open upvalue for the local
+		Upvalue* NewUpvalue(Value* local);
+		//copies length characters and adds the terminator
+		_JetGCString* NewString(const char* data, size_t length);
+
+		//finishes the collection going on, or does a whole one
 		void Run();
+
+		//does at most budget microseconds of work, starting a collection if there isnt one going on
+		//returns true if that finished the collection
+		bool Step(unsigned int budget);
+
+		//bytes in use by the heap's cells and what they hold
+		size_t Bytes() const
+		{
+			return this->heap.size() + this->external;
+		}
+
+		//counts storage allocated for something already in the heap, like an array growing
+		void Account(size_t bytes)
+		{
+			this->allocated += bytes;
+			this->external += bytes;
+		}
+
+		//if enough has been allocated to call Collect, the script checks this after allocating
+		bool Due() const
+		{
+			return this->allocated >= this->pacing.nursery;
+		}
+
+		void Collect()
+		{
+			this->allocated = 0;
+			if (this->pacing.pause && (this->pacing.maxheap == 0 || this->Bytes() < this->pacing.maxheap))
+				this->Step(this->pacing.pause);
+			else
+				this->Run();
+		}
+
+		//write barrier for values stored in an object, array, userdata prototype or upvalue
+		//old ones that are written to get traversed again by the next collection, so what was stored in them isnt freed
+		void Remember(const Value& v)
+		{
+			if (v._object()->mark)
+			{
+				v._object()->mark = false;
+				this->remembered.push_back(v);
+			}
+		}
+
+		//write barrier for values stored in roots, so they dont all have to be traversed when marking finishes
+		void Shade(const Value& v)
+		{
+			if (this->phase == GCPhase::Mark)
+				this->Grey(v);
+		}
+
 	private:
-		void Mark();
-		void Sweep();
+		//makes a white value grey, strings have nothing to traverse so they go straight to black
+		void Grey(const Value& v)
+		{
+			if (v.type() > ValueType::String)
+			{
+				if (v._object()->grey == false)
+				{
+					v._object()->grey = true;
+					this->greys.push_back(v);
+				}
+			}
+			else if (v.type() == ValueType::String && v.collected())
+			{
+				auto str = _JetGCString::Get(v._string());
+				str->grey = str->mark = true;
+			}
+		}
+
+		bool Work(size_t work);
+		void MarkRoots();
+		void Propagate(size_t& work);
 	};
 }
 #endif
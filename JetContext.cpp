@@ -11,6 +11,7 @@
 #include "JetContext.h"
 
 #include <stack>
+#include <algorithm>
 
 using namespace Jet;
 
@@ -59,6 +60,7 @@ Value JetContext::Get(const std::string& name)
 
 void JetContext::Set(const std::string& name, const Value& value)
 {
+	this->gc.Shade(value);//write barrier
 	auto iter = variables.find(name);
 	if (iter == variables.end())
 	{
@@ -74,58 +76,75 @@ void JetContext::Set(const std::string& name, const Value& value)
 
 Value JetContext::NewObject()
 {
-	auto v = new _JetObject;
-	v->grey = v->mark = false;
-	v->ptr = new _JetObjectBacking;
-	this->gc.objects.push_back(v);
-	return Value(v);
+	return Value(this->gc.NewObject(this->rootshape));
 }
 
 Value JetContext::NewPrototype(const char* Typename)
 {
 	auto v = new _JetObject;
 	v->grey = v->mark = false;
-	v->ptr = new _JetObjectBacking;
+	v->unmanaged = true;
+	v->ptr = new _JetObjectBacking(this->rootshape);
 	return v;
 }
 
+void JetContext::Remember(const Value& container)
+{
+	if (container.type() == ValueType::Object || container.type() == ValueType::Array)
+		this->gc.Remember(container);
+}
+
 Value JetContext::NewArray()
 {
-	auto a = new _JetArray;
-	a->grey = a->mark = false;
-	a->ptr = new _JetArrayBacking;
-	this->gc.arrays.push_back(a);
-	return Value(a);
+	return Value(this->gc.NewArray(0));
 }
 
 Value JetContext::NewUserdata(void* data, const Value& proto)
 {
-	if (proto.type != ValueType::Object)
+	if (proto.type() != ValueType::Object)
 		throw RuntimeException("NewUserdata: Prototype supplied was not of the type 'object'\n");
 	
-	auto ud = new GCVal<std::pair<void*, _JetObject*>>(std::pair<void*, _JetObject*>(data, proto._object));
-	ud->grey = ud->mark = true;
-	this->gc.userdata.push_back(ud);
-	return Value(ud, proto._object);
+	return Value(this->gc.NewUserdata(data, proto._object()));
 }
 
 Value JetContext::NewString(char* string, bool copy)
 {
-	if (copy)
+	auto str = this->gc.NewString(string, strlen(string));
+	if (copy == false)
+		delete[] string;
+	return Value(str);
+}
+
+Value JetContext::Intern(const char* string)
+{
+	size_t length = strlen(string);
+	size_t hash = HashFunction::Hash(string, length);
+	auto range = this->interned.equal_range(hash);
+	for (auto ii = range.first; ii != range.second; ii++)
 	{
-		size_t len = strlen(string);
-		auto temp = new char[len];
-		memcpy(temp, string, len);
-		string = temp;
+		if (ii->second->length == length && memcmp(ii->second->data, string, length) == 0)
+			return Value(ii->second);
 	}
-	this->gc.strings.push_back(new GCVal<char*>(string));
-	return Value(string);
+
+	auto str = (_JetInternedString*)new char[sizeof(_JetInternedString) + length];
+	str->hash = hash;
+	str->length = length;
+	memcpy(str->data, string, length+1);
+	this->interned.insert(std::pair<size_t, _JetInternedString*>(hash, str));
+	return Value(str);
 }
 
 JetContext::JetContext() : gc(this), stack(500000)
 {
 	this->labelposition = 0;
+	this->rootshape = new Shape;
 	this->fptr = -1;
+	this->openupvals = 0;
+	this->compiler.registers = true;
+	this->compiler.superinstructions = true;
+#ifdef JET_PROFILE_OPCODES
+	this->opcodepairs.resize(((int)InstructionType::Function+1)*((int)InstructionType::Function+1));
+#endif
 	
 	//add more functions and junk
 	(*this)["print"] = print;
@@ -135,10 +154,13 @@ JetContext::JetContext() : gc(this), stack(500000)
 		if (args != 2)
 			throw RuntimeException("Invalid Call, Improper Arguments!");
 
-		if (v->type == ValueType::Object && v[1].type == ValueType::Object)
+		if (v->type() == ValueType::Object && v[1].type() == ValueType::Object)
 		{
 			Value val = v[0];
-			val.prototype = v[1]._object;
+			val.SetPrototype(v[1]._object());
+
+			//write barrier
+			context->gc.Remember(val);
 			context->Return(val);
 		}
 		else
@@ -152,10 +174,13 @@ JetContext::JetContext() : gc(this), stack(500000)
 		if (args != 2)
 			throw RuntimeException("Invalid Call, Improper Arguments!");
 
-		if (v->type == ValueType::Object && v[1].type == ValueType::Object)
+		if (v->type() == ValueType::Object && v[1].type() == ValueType::Object)
 		{
 			Value val = *v;
-			val.prototype = v[1]._object;
+			val.SetPrototype(v[1]._object());
+
+			//write barrier
+			context->gc.Remember(val);
 			context->Return(val);
 		}
 		else
@@ -166,7 +191,7 @@ JetContext::JetContext() : gc(this), stack(500000)
 
 	(*this)["getprototype"] = [](JetContext* context, Value* v, int args)
 	{
-		if (args == 1 && (v->type == ValueType::Object || v->type == ValueType::Userdata))
+		if (args == 1 && (v->type() == ValueType::Object || v->type() == ValueType::Userdata))
 		{
 			context->Return(v->GetPrototype());
 		}
@@ -175,15 +200,16 @@ JetContext::JetContext() : gc(this), stack(500000)
 	};
 
 
-	this->file.ptr = new _JetObjectBacking;//std::map<std::string, Value>;
+	this->file.ptr = new _JetObjectBacking(this->rootshape);//std::map<std::string, Value>;
 	(*file.ptr)["read"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args != 2)
 			throw RuntimeException("Invalid number of arguments to read!");
 
-		char* out = new char[((int)v->value)+1];//context->GCAllocate((v)->value);
-		fread(out, 1, (int)(v)->value, v[1].GetUserdata<FILE>());
-		out[(int)(v)->value] = 0;
+		int length = (int)v[0];
+		char* out = new char[length+1];//context->GCAllocate((v)->value);
+		fread(out, 1, length, v[1].GetUserdata<FILE>());
+		out[length] = 0;
 		context->Return(context->NewString(out, false));
 	});
 	(*file.ptr)["write"] = Value([](JetContext* context, Value* v, int args)
@@ -218,17 +244,18 @@ JetContext::JetContext() : gc(this), stack(500000)
 
 
 	//setup the string and array tables
-	this->string.ptr = new _JetObjectBacking;
+	this->string.ptr = new _JetObjectBacking(this->rootshape);
 	(*this->string.ptr)["append"] = Value([](JetContext* context, Value* v, int args)
 	{
-		if (args == 2 && v[0].type == ValueType::String && v[1].type == ValueType::String)
+		if (args == 2 && v[0].type() == ValueType::String && v[1].type() == ValueType::String)
 		{
-			size_t len = v[0].length + v[1].length + 1;
+			size_t len0 = strlen(v[0]._string()), len1 = strlen(v[1]._string());
+			size_t len = len0 + len1 + 1;
 			char* text = new char[len];
-			memcpy(text, v[0]._string, v[0].length);
-			memcpy(text+v[0].length, v[1]._string, v[1].length);
+			memcpy(text, v[0]._string(), len0);
+			memcpy(text+len0, v[1]._string(), len1);
 			text[len-1] = 0;
-			context->Return(text);
+			context->Return(context->NewString(text, false));
 		}
 		else
 			throw RuntimeException("bad append call!");
@@ -236,17 +263,31 @@ JetContext::JetContext() : gc(this), stack(500000)
 	(*this->string.ptr)["length"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 1)
-			context->Return(Value((double)strlen(v->_string)));
+		{
+			if (v->interned())
+				context->Return(Value((int)_JetInternedString::Get(v->_string())->length));
+			else if (v->collected())
+				context->Return(Value((int)_JetGCString::Get(v->_string())->length));
+			else
+				context->Return(Value((int)strlen(v->_string())));
+		}
 		else
 			throw RuntimeException("bad length call!");
 	});
 
-	this->Array.ptr = new _JetObjectBacking;//std::map<std::string, Value>;
+	this->Array.ptr = new _JetObjectBacking(this->rootshape);//std::map<std::string, Value>;
 	(*this->Array.ptr)["add"] = Value([](JetContext* context, Value* v, int args)
 	{
 		if (args == 2)
 		{
-			v[1]._array->ptr->push_back(*v);
+			auto arr = v[1]._array()->ptr;
+			size_t capacity = arr->capacity();
+			arr->push_back(*v);
+			if (arr->capacity() != capacity)
+				context->gc.Account((arr->capacity() - capacity)*sizeof(Value));
+
+			//write barrier
+			context->gc.Remember(v[1]);
 			//(*(v+1)->_array->ptr)[(v+1)->_array->ptr->size()] = *(v);
 		}
 		else
@@ -256,7 +297,7 @@ JetContext::JetContext() : gc(this), stack(500000)
 	{
 		//how do I get access to the array from here?
 		if (args == 1)
-			context->Return((int)v->_array->ptr->size());
+			context->Return((int)v->_array()->ptr->size());
 		else
 			throw RuntimeException("Invalid size call!!");
 	});
@@ -264,7 +305,13 @@ JetContext::JetContext() : gc(this), stack(500000)
 	{
 		//how do I get access to the array from here?
 		if (args == 2)
-			v[1]._array->ptr->resize(v->value);
+		{
+			auto arr = v[1]._array()->ptr;
+			size_t capacity = arr->capacity();
+			arr->resize((int)v[0]);
+			if (arr->capacity() > capacity)
+				context->gc.Account((arr->capacity() - capacity)*sizeof(Value));
+		}
 		else
 			throw RuntimeException("Invalid size call!!");
 	});
@@ -279,19 +326,19 @@ JetContext::JetContext() : gc(this), stack(500000)
 				std::vector<Value>::iterator iterator;
 			};
 			iter* it = new iter;
-			it->container = v->_array->ptr;
-			it->iterator = v->_array->ptr->begin();
+			it->container = v->_array()->ptr;
+			it->iterator = v->_array()->ptr->begin();
 			context->Return(context->NewUserdata(it, &context->arrayiter));
 			return;
 		}
 		throw RuntimeException("Bad call to getIterator");
 	});
-	this->object.ptr = new _JetObjectBacking;//std::map<std::string, Value>;
+	this->object.ptr = new _JetObjectBacking(this->rootshape);//std::map<std::string, Value>;
 	(*this->object.ptr)["size"] = Value([](JetContext* context, Value* v, int args)
 	{
 		//how do I get access to the array from here?
 		if (args == 1)
-			context->Return((int)v->_object->ptr->size());
+			context->Return((int)v->_object()->ptr->size());
 		else
 			throw RuntimeException("Invalid size call!!");
 	});
@@ -306,14 +353,14 @@ JetContext::JetContext() : gc(this), stack(500000)
 				_JetObjectIterator iterator;
 			};
 			iter2* it = new iter2;
-			it->container = v->_object->ptr;
-			it->iterator = v->_object->ptr->begin();
+			it->container = v->_object()->ptr;
+			it->iterator = v->_object()->ptr->begin();
 			context->Return(context->NewUserdata(it, &context->objectiter));
 			return;
 		}
 		throw RuntimeException("Bad call to getIterator");
 	});
-	this->objectiter.ptr = new _JetObjectBacking;//std::map<std::string, Value>;
+	this->objectiter.ptr = new _JetObjectBacking(this->rootshape);//std::map<std::string, Value>;
 	(*this->objectiter.ptr)["next"] = Value([](JetContext* context, Value* v, int args)
 	{
 		struct iter2
@@ -367,7 +414,7 @@ JetContext::JetContext() : gc(this), stack(500000)
 		};
 		delete v->GetUserdata<iter2>();
 	});
-	this->arrayiter.ptr = new _JetObjectBacking;//std::map<std::string, Value>;
+	this->arrayiter.ptr = new _JetObjectBacking(this->rootshape);//std::map<std::string, Value>;
 	(*this->arrayiter.ptr)["next"] = Value([](JetContext* context, Value* v, int args)
 	{
 		struct iter
@@ -423,12 +470,34 @@ JetContext::JetContext() : gc(this), stack(500000)
 	});
 };
 
+//frees what the assembler allocated for an instruction
+static void FreeInstruction(Instruction& ins)
+{
+	switch (ins.instruction)
+	{
+	case InstructionType::LoadAt:
+	case InstructionType::StoreAt:
+	case InstructionType::Invoke:
+	case InstructionType::TailInvoke:
+		if (ins.string)
+			delete ins.cache;
+		return;//the string is interned
+	case InstructionType::LdStr:
+		return;
+	default:
+		delete[] ins.string;
+	}
+}
+
 JetContext::~JetContext()
 {
 	this->gc.Cleanup();
 
-	for (auto ii: this->ins)
-		delete[] ii.string;
+	for (auto& ii: this->ins)
+		FreeInstruction(ii);
+
+	for (auto ii: this->interned)
+		delete[] (char*)ii.second;
 
 	for (auto ii: this->functions)
 		delete ii.second;
@@ -442,6 +511,8 @@ JetContext::~JetContext()
 	delete this->object.ptr;
 	delete this->arrayiter.ptr;
 	delete this->objectiter.ptr;
+
+	delete this->rootshape;
 }
 
 #ifndef _WIN32
@@ -518,6 +589,364 @@ void JetContext::RunGC()
 	this->gc.Run();
 }
 
+bool JetContext::GCStep(unsigned int budget)
+{
+	return this->gc.Step(budget);
+}
+
+void JetContext::SetGCPacing(const GCPacing& pacing)
+{
+	this->gc.pacing = pacing;
+}
+
+void JetContext::SetGCThreads(unsigned int threads)
+{
+	this->gc.marker.SetThreads(threads ? threads : 1);
+}
+
+void JetContext::SetGCBackgroundSweep(bool background)
+{
+	this->gc.heap.SetBackgroundSweep(background);
+}
+
+void JetContext::UseRegisterInstructions(bool use)
+{
+	this->compiler.registers = use;
+}
+
+void JetContext::UseSuperinstructions(bool use)
+{
+	this->compiler.superinstructions = use;
+}
+
+#ifdef JET_PROFILE_OPCODES
+void JetContext::PrintOpcodeProfile(unsigned int count)
+{
+	const int types = (int)InstructionType::Function+1;
+	std::vector<std::pair<unsigned long long, int>> pairs;
+	unsigned long long total = 0;
+	for (int i = 0; i < types*types; i++)
+	{
+		total += this->opcodepairs[i];
+		if (this->opcodepairs[i])
+			pairs.push_back(std::pair<unsigned long long, int>(this->opcodepairs[i], i));
+	}
+	std::sort(pairs.begin(), pairs.end(), [](const std::pair<unsigned long long, int>& a, const std::pair<unsigned long long, int>& b) { return a.first > b.first; });
+
+	printf("Opcode pairs, %llu instructions executed\n", total);
+	for (unsigned int i = 0; i < pairs.size() && i < count; i++)
+		printf("%-15s %-15s %llu (%.2lf%%)\n", Instructions[pairs[i].second/types], Instructions[pairs[i].second%types], pairs[i].first, 100.0*(double)pairs[i].first/(double)total);
+}
+#endif
+
+//looks up a string key on a value the way LoadAt does
+//objects fall back to their prototype then the object prototype
+Value JetContext::GetMember(const Value& loc, const Value& key)
+{
+	Value* v;
+	if (loc.type() == ValueType::Object)
+	{
+		if ((v = loc._object()->ptr->Find(key)) || (loc._object()->prototype && (v = loc._object()->prototype->ptr->Find(key))) || (v = this->object.ptr->Find(key)))
+			return *v;
+		return Value();
+	}
+	else if (loc.type() == ValueType::String)
+		v = this->string.ptr->Find(key);
+	else if (loc.type() == ValueType::Array)
+		v = this->Array.ptr->Find(key);
+	else if (loc.type() == ValueType::Userdata)
+		v = loc._userdata()->ptr.second->ptr->Find(key);
+	else
+		throw RuntimeException("Could not index a non array/object value!");
+	return v ? *v : Value();
+}
+
+//finds the slot holding a string key in an object or its prototype using an inline cache
+//hits only compare shapes, misses look the key up and replace the oldest entry
+//returns null if it isnt in either
+Value* JetContext::GetCachedMember(_JetObject* obj, const Value& key, PropertyCache* cache)
+{
+	Shape* shape = obj->ptr->GetShape();
+	if (shape)
+	{
+		for (int i = 0; i < JET_PROPERTY_CACHE_SIZE; i++)
+		{
+			auto& entry = cache->entries[i];
+			if (entry.shape == shape && entry.transition == 0 && entry.table == 0)
+			{
+				if (entry.prototype == 0)
+					return &obj->ptr->GetSlot(entry.slot);
+				else if (obj->prototype && obj->prototype->ptr->GetShape() == entry.prototype)
+					return &obj->prototype->ptr->GetSlot(entry.slot);
+			}
+		}
+	}
+
+	int slot = obj->ptr->IndexOf(key);
+	if (slot >= 0)
+	{
+		if (shape)
+		{
+			auto& entry = cache->entries[cache->next];
+			entry.shape = shape;
+			entry.prototype = 0;
+			entry.transition = 0;
+			entry.table = 0;
+			entry.slot = slot;
+			cache->next = (cache->next+1)%JET_PROPERTY_CACHE_SIZE;
+		}
+		return &obj->ptr->GetSlot(slot);
+	}
+	else if (obj->prototype && (slot = obj->prototype->ptr->IndexOf(key)) >= 0)
+	{
+		//the object's shape says it doesnt have the key, so the prototype's shape is enough
+		if (shape && obj->prototype->ptr->GetShape())
+		{
+			auto& entry = cache->entries[cache->next];
+			entry.shape = shape;
+			entry.prototype = obj->prototype->ptr->GetShape();
+			entry.transition = 0;
+			entry.table = 0;
+			entry.slot = slot;
+			cache->next = (cache->next+1)%JET_PROPERTY_CACHE_SIZE;
+		}
+		return &obj->prototype->ptr->GetSlot(slot);
+	}
+	return 0;
+}
+
+//stores a string key in an object using an inline cache
+//also caches adding the key, so objects built the same way dont need to look up the transition
+void JetContext::SetCachedMember(_JetObject* obj, const Value& key, const Value& value, PropertyCache* cache)
+{
+	Shape* shape = obj->ptr->GetShape();
+	if (shape)
+	{
+		for (int i = 0; i < JET_PROPERTY_CACHE_SIZE; i++)
+		{
+			auto& entry = cache->entries[i];
+			if (entry.shape == shape && entry.prototype == 0)
+			{
+				if (entry.transition)
+					obj->ptr->AddSlot(entry.transition, value);
+				else
+					obj->ptr->GetSlot(entry.slot) = value;
+				return;
+			}
+		}
+	}
+
+	int slot = obj->ptr->IndexOf(key);
+	if (slot < 0)
+	{
+		(*obj->ptr)[key] = value;
+		Shape* next = obj->ptr->GetShape();
+		if (shape && next)
+		{
+			auto& entry = cache->entries[cache->next];
+			entry.shape = shape;
+			entry.prototype = 0;
+			entry.transition = next;
+			entry.table = 0;
+			entry.slot = next->keys.size()-1;
+			cache->next = (cache->next+1)%JET_PROPERTY_CACHE_SIZE;
+		}
+		return;
+	}
+
+	obj->ptr->GetSlot(slot) = value;
+	if (shape)
+	{
+		auto& entry = cache->entries[cache->next];
+		entry.shape = shape;
+		entry.prototype = 0;
+		entry.transition = 0;
+		entry.table = 0;
+		entry.slot = slot;
+		cache->next = (cache->next+1)%JET_PROPERTY_CACHE_SIZE;
+	}
+}
+
+//finds the method an Invoke calls, builtin types keep theirs in a table of their own
+//objects look in themselves and their prototype and then in the object table
+//methods from the object table are cached by the shapes of the receiver and its prototype
+//since those shapes not having the key is what sends the lookup there
+Value JetContext::GetCachedMethod(const Value& self, const Value& key, PropertyCache* cache)
+{
+	Value* slot;
+	switch (self.type())
+	{
+	case ValueType::Object:
+		{
+			_JetObject* obj = self._object();
+			Shape* shape = obj->ptr->GetShape();
+			Shape* proto = obj->prototype ? obj->prototype->ptr->GetShape() : 0;
+			Shape* table = this->object.ptr->GetShape();
+			bool cacheable = shape && table && (obj->prototype == 0 || proto);
+			if (cacheable)
+			{
+				for (int i = 0; i < JET_PROPERTY_CACHE_SIZE; i++)
+				{
+					auto& entry = cache->entries[i];
+					if (entry.table == table && entry.shape == shape && entry.prototype == proto)
+						return this->object.ptr->GetSlot(entry.slot);
+				}
+			}
+
+			if ((slot = this->GetCachedMember(obj, key, cache)) == 0)
+			{
+				int i = this->object.ptr->IndexOf(key);
+				if (i < 0)
+					return Value();
+
+				if (cacheable)
+				{
+					auto& entry = cache->entries[cache->next];
+					entry.shape = shape;
+					entry.prototype = proto;
+					entry.transition = 0;
+					entry.table = table;
+					entry.slot = i;
+					cache->next = (cache->next+1)%JET_PROPERTY_CACHE_SIZE;
+				}
+				slot = &this->object.ptr->GetSlot(i);
+			}
+			break;
+		}
+	case ValueType::String:
+		slot = this->GetCachedMember(&this->string, key, cache);
+		break;
+	case ValueType::Array:
+		slot = this->GetCachedMember(&this->Array, key, cache);
+		break;
+	case ValueType::Userdata:
+		slot = this->GetCachedMember(self._userdata()->ptr.second, key, cache);
+		break;
+	default:
+		throw RuntimeException("Could not index a non array/object value!");
+	}
+	return slot ? *slot : Value();
+}
+
+//for each loops cant go back into scripts from the middle of an instruction, so userdata need native iterators
+void JetContext::CallIterator(const Value& iter, const char* method, int iptr)
+{
+	Value fun = this->GetMember(iter, this->Intern(method));
+	if (fun.type() != ValueType::NativeFunction)
+		throw RuntimeException("Userdata iterators need a native " + std::string(method) + " function!");
+
+	callstack.Push(std::pair<unsigned int, Closure*>(iptr, curframe));
+	callstack.Push(std::pair<unsigned int, Closure*>(123456789, curframe));
+
+	Value self = iter;
+	int s = stack.size();
+	(*fun.func())(this, &self, 1);
+
+	callstack.QuickPop(2);
+	if (stack.size() == s)
+		stack.Push(Value());
+	else if (stack.size() > s + 1)
+		stack.QuickPop(stack.size() - s - 1);
+}
+
+Upvalue* JetContext::FindUpvalue(Value* local)
+{
+	Upvalue** link = &this->openupvals;
+	while (*link && (*link)->v > local)
+		link = &(*link)->next;
+
+	if (*link && (*link)->v == local)
+		return *link;
+
+	Upvalue* upvalue = this->gc.NewUpvalue(local);
+	upvalue->next = *link;
+	*link = upvalue;
+	return upvalue;
+}
+
+void JetContext::Close(Value* level)
+{
+	while (this->openupvals && this->openupvals->v >= level)
+	{
+		Upvalue* upvalue = this->openupvals;
+		upvalue->closed = *upvalue->v;
+		upvalue->v = &upvalue->closed;
+		this->openupvals = upvalue->next;
+
+		//write barrier, the upvalue holds the value itself now
+		this->gc.Remember(Value(upvalue));
+	}
+}
+
+//marks the integer fast paths as the common case
+//without it gcc moves them out of line now that checking the tag is a single compare
+#if defined(__GNUC__) || defined(__clang__)
+#define JET_LIKELY(x) __builtin_expect(!!(x), 1)
+#else
+#define JET_LIKELY(x) (x)
+#endif
+
+//a < b and a <= b for the comparison instructions
+//integers and doubles are compared directly, anything that isnt a number throws from the conversion
+static inline bool LessThan(Value& a, Value& b)
+{
+	if (JET_LIKELY(a.IsInteger() && b.IsInteger()))
+		return a.integer() < b.integer();
+	else if (a.IsNumber() && b.IsNumber())
+		return a.value() < b.value();
+	return (double)a < (double)b;
+}
+
+static inline bool LessEqual(Value& a, Value& b)
+{
+	if (JET_LIKELY(a.IsInteger() && b.IsInteger()))
+		return a.integer() <= b.integer();
+	else if (a.IsNumber() && b.IsNumber())
+		return a.value() <= b.value();
+	return (double)a <= (double)b;
+}
+
+//moves the arguments of a call off the operand stack into the locals of the frame at sptr
+//missing ones are null, extra ones go in the vararg array or are dropped
+inline void JetContext::PopArguments(Function* func, unsigned int args)
+{
+	if (args <= func->args)
+	{
+		for (int i = func->args-1; i >= 0; i--)
+		{
+			if (i < (int)args)
+				sptr[i] = stack.PopUnchecked();
+			else
+				sptr[i] = Value();
+		}
+	}
+	else if (func->vararg)
+	{
+		sptr[func->locals-1] = Value(this->gc.NewArray(args - func->args));
+		auto arr = sptr[func->locals-1]._array()->ptr;
+		for (int i = (int)args-1; i >= 0; i--)
+		{
+			if (i < (int)func->args)
+				sptr[i] = stack.PopUnchecked();
+			else
+				(*arr)[i - func->args] = stack.PopUnchecked();
+		}
+
+		//write barrier
+		gc.Remember(sptr[func->locals-1]);
+	}
+	else
+	{
+		for (int i = (int)args-1; i >= 0; i--)
+		{
+			if (i < (int)func->args)
+				sptr[i] = stack.PopUnchecked();
+			else
+				stack.PopUnchecked();
+		}
+	}
+}
+
 Value JetContext::Execute(int iptr)
 {
 #ifdef JET_TIME_EXECUTION
@@ -536,340 +965,448 @@ Value JetContext::Execute(int iptr)
 
 	try
 	{
+		if (this->stack.headroom() < this->curframe->prototype->maxstack)
+			throw RuntimeException("Stack overflow");
+
 		int max = ins.size();
+		const Instruction* in;
+		Value fun;//what the next call goes to, Invoke finds it without going through the stack
+
+#ifdef JET_THREADED_DISPATCH
+		//handler addresses, must be kept in the same order as InstructionType
+		static const void* const handlers[] = {
+			&&op_Add, &&op_Mul, &&op_Div, &&op_Sub, &&op_Modulus,
+			&&op_Negate,
+			&&op_BAnd, &&op_BOr, &&op_Xor, &&op_BNot, &&op_LeftShift, &&op_RightShift,
+			&&op_Eq, &&op_NotEq, &&op_Lt, &&op_Gt, &&op_LtE, &&op_GtE,
+			&&op_Incr, &&op_Decr,
+			&&op_Dup, &&op_Pop,
+			&&op_LdNum, &&op_LdInt, &&op_LdNull, &&op_LdStr, &&op_LoadFunction,
+			&&op_Jump, &&op_JumpTrue, &&op_JumpFalse,
+			&&op_JumpIfNotLt, &&op_JumpIfNotGt, &&op_JumpIfNotLtE, &&op_JumpIfNotGtE, &&op_JumpIfNotEq, &&op_JumpIfEq,
+			&&op_NewArray, &&op_NewObject,
+			&&op_Store, &&op_Load,
+			&&op_LStore, &&op_LLoad,
+			&&op_CStore, &&op_CLoad, &&op_Invalid,//CInit only describes captures to the assembler
+			&&op_LoadAt, &&op_StoreAt,
+			&&op_IterPrep, &&op_IterNext, &&op_IterKey,
+			&&op_ForRangePrep, &&op_ForRangeLoop,
+			&&op_ECall, &&op_TailCall, &&op_Invoke, &&op_TailInvoke,
+			&&op_Call, &&op_Return,
+			&&op_Close,
+			&&op_RAdd, &&op_RSub, &&op_RMul, &&op_RDiv, &&op_RModulus, &&op_RMove,
+			&&op_LAddInt, &&op_LSubInt, &&op_LIncr, &&op_LDecr,
+			//the assembler never emits these
+			&&op_Invalid, &&op_Invalid, &&op_Invalid, &&op_Invalid
+		};
+		static_assert(sizeof(handlers)/sizeof(handlers[0]) == (int)InstructionType::Function+1, "Threaded dispatch table is out of sync with InstructionType!");
+
+		//decode anything assembled since the last run into handler addresses
+		for (size_t i = this->threadedcode.size(); i < this->ins.size(); i++)
+			this->threadedcode.push_back(handlers[(int)this->ins[i].instruction]);
+
+		//each handler jumps straight to the next one instead of going back through the switch
+		//only Return can leave the function, so it is the only one that checks the bounds
+#define VMCASE(x) case InstructionType::x: op_##x:
+#define VMNEXT() { in = &ins[++iptr]; goto *threadedcode[iptr]; }
+#define VMCHECKEDNEXT() { if (++iptr >= max || iptr < 0) goto vmexit; in = &ins[iptr]; goto *threadedcode[iptr]; }
+
+		if (iptr >= max || iptr < 0)
+			goto vmexit;
+		in = &ins[iptr];
+		goto *threadedcode[iptr];
+#else
+#define VMCASE(x) case InstructionType::x:
+#define VMNEXT() break
+#define VMCHECKEDNEXT() break
+#endif
+
+#ifdef JET_PROFILE_OPCODES
+		int lastop = (int)InstructionType::Function;
+#endif
 		while(iptr < max && iptr >= 0)
 		{
-			Instruction in = ins[iptr];
-			switch(in.instruction)
+			in = &ins[iptr];
+#ifdef JET_PROFILE_OPCODES
+			this->opcodepairs[lastop*((int)InstructionType::Function+1)+(int)in->instruction]++;
+			lastop = (int)in->instruction;
+#endif
+			switch(in->instruction)
 			{
-			case InstructionType::Add:
+			VMCASE(Add)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(one+two);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					//integers only have 48 bits so the sum cant overflow, Value turns it into a number if it doesnt fit
+					if (JET_LIKELY(one.IsInteger() && two.IsInteger()))
+						stack.PushUnchecked(Value(one.integer()+two.integer()));
+					else
+						stack.PushUnchecked(one+two);
+					VMNEXT();
 				}
-			case InstructionType::Sub:
+			VMCASE(Sub)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two-one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					if (JET_LIKELY(one.IsInteger() && two.IsInteger()))
+						stack.PushUnchecked(Value(two.integer()-one.integer()));
+					else
+						stack.PushUnchecked(two-one);
+					VMNEXT();
 				}
-			case InstructionType::Mul:
+			VMCASE(Mul)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(one*two);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					long long result;
+					if (one.IsInteger() && two.IsInteger() && IntegerMul(one.integer(), two.integer(), result))
+						stack.PushUnchecked(Value(result));
+					else
+						stack.PushUnchecked(one*two);
+					VMNEXT();
 				}
-			case InstructionType::Div:
+			VMCASE(Div)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two/one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two/one);
+					VMNEXT();
 				}
-			case InstructionType::Modulus:
+			VMCASE(Modulus)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two%one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two%one);
+					VMNEXT();
 				}
-			case InstructionType::BAnd:
+			VMCASE(BAnd)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two&one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two&one);
+					VMNEXT();
 				}
-			case InstructionType::BOr:
+			VMCASE(BOr)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two|one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two|one);
+					VMNEXT();
 				}
-			case InstructionType::Xor:
+			VMCASE(Xor)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two^one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two^one);
+					VMNEXT();
 				}
-			case InstructionType::BNot:
+			VMCASE(BNot)
 				{
-					Value one = stack.Pop();
-					stack.Push(~one);
-					break;
+					Value one = stack.PopUnchecked();
+					stack.PushUnchecked(~one);
+					VMNEXT();
 				}
-			case InstructionType::LeftShift:
+			VMCASE(LeftShift)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two<<one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two<<one);
+					VMNEXT();
 				}
-			case InstructionType::RightShift:
+			VMCASE(RightShift)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
-					stack.Push(two>>one);
-					break;
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
+					stack.PushUnchecked(two>>one);
+					VMNEXT();
 				}
-			case InstructionType::Incr:
+			VMCASE(Incr)
 				{
-					Value one = stack.Pop();
+					Value one = stack.PopUnchecked();
 
-					stack.Push(one+Value(1));
-					break;
+					if (JET_LIKELY(one.IsInteger()))
+						stack.PushUnchecked(Value(one.integer()+1));
+					else
+						stack.PushUnchecked(one+Value(1));
+					VMNEXT();
 				}
-			case InstructionType::Decr:
+			VMCASE(Decr)
 				{
-					Value one = stack.Pop();
+					Value one = stack.PopUnchecked();
 
-					stack.Push(one-Value(1));
-					break;
+					if (JET_LIKELY(one.IsInteger()))
+						stack.PushUnchecked(Value(one.integer()-1));
+					else
+						stack.PushUnchecked(one-Value(1));
+					VMNEXT();
 				}
-			case InstructionType::Negate:
+			VMCASE(Negate)
 				{
-					Value one = stack.Pop();
-					stack.Push(-one);
-					break;
+					Value one = stack.PopUnchecked();
+					stack.PushUnchecked(-one);
+					VMNEXT();
 				}
-			case InstructionType::Eq:
+			VMCASE(Eq)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
 
 					if (one == two)
-						stack.Push(Value(1));
+						stack.PushUnchecked(Value(1));
 					else
-						stack.Push(Value(0));
+						stack.PushUnchecked(Value(0));
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::NotEq:
+			VMCASE(NotEq)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
+					Value one = stack.PopUnchecked();
+					Value two = stack.PopUnchecked();
 
 					if (one == two)
-						stack.Push(Value(0));
+						stack.PushUnchecked(Value(0));
 					else
-						stack.Push(Value(1));
+						stack.PushUnchecked(Value(1));
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::Lt:
+			VMCASE(Lt)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					if ((double)one > (double)two)
-						stack.Push(Value(1));
+					if (LessThan(two, one))
+						stack.PushUnchecked(Value(1));
 					else
-						stack.Push(Value(0));
+						stack.PushUnchecked(Value(0));
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::Gt:
+			VMCASE(Gt)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					if ((double)one < (double)two)
-						stack.Push(Value(1));
+					if (LessThan(one, two))
+						stack.PushUnchecked(Value(1));
 					else
-						stack.Push(Value(0));
+						stack.PushUnchecked(Value(0));
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::GtE:
+			VMCASE(GtE)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					if ((double)one <= (double)two)
-						stack.Push(Value(1));
+					if (LessEqual(one, two))
+						stack.PushUnchecked(Value(1));
 					else
-						stack.Push(Value(0));
+						stack.PushUnchecked(Value(0));
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::LtE:
+			VMCASE(LtE)
 				{
-					Value one = stack.Pop();
-					Value two = stack.Pop();
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					if ((double)one >= (double)two)
-						stack.Push(Value(1));
+					if (LessEqual(two, one))
+						stack.PushUnchecked(Value(1));
 					else
-						stack.Push(Value(0));
+						stack.PushUnchecked(Value(0));
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::LdNull:
+			VMCASE(LdInt)
 				{
-					stack.Push(Value());
-					break;
+					stack.PushUnchecked(Value(in->integer));
+					VMNEXT();
 				}
-			case InstructionType::LdNum:
+			VMCASE(LdNull)
 				{
-					stack.Push(in.value2);
-					break;
+					stack.PushUnchecked(Value());
+					VMNEXT();
 				}
-			case InstructionType::LdStr:
+			VMCASE(LdNum)
 				{
-					stack.Push(in.string);
-					break;
+					stack.PushUnchecked(in->value2);
+					VMNEXT();
 				}
-			case InstructionType::Jump:
+			VMCASE(LdStr)
 				{
-					iptr = in.value-1;
-					break;
+					stack.PushUnchecked(_JetInternedString::Get(in->string));
+					VMNEXT();
+				}
+			VMCASE(Jump)
+				{
+					iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::JumpTrue:
+			VMCASE(JumpTrue)
 				{
-					auto temp = stack.Pop();
-					switch (temp.type)
+					auto temp = stack.PopUnchecked();
+					switch (temp.type())
 					{
 					case ValueType::Number:
-						if (temp.value != 0.0)
-							iptr = in.value-1;
+						if (temp.value() != 0.0)
+							iptr = in->value-1;
+						break;
+					case ValueType::Integer:
+						if (temp.integer() != 0)
+							iptr = in->value-1;
 						break;
 					case ValueType::Null:
 						break;
 					default:
-						iptr = in.value-1;
+						iptr = in->value-1;
 					}
 					//if ((int)temp)
-					//	iptr = in.value-1;
-					break;
+					//	iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::JumpFalse:
+			VMCASE(JumpFalse)
 				{
-					auto temp = stack.Pop();
-					switch (temp.type)
+					auto temp = stack.PopUnchecked();
+					switch (temp.type())
 					{
 					case ValueType::Number:
-						if (temp.value == 0.0)
-							iptr = in.value-1;
+						if (temp.value() == 0.0)
+							iptr = in->value-1;
+						break;
+					case ValueType::Integer:
+						if (temp.integer() == 0)
+							iptr = in->value-1;
 						break;
 					case ValueType::Null:
-						iptr = in.value-1;
+						iptr = in->value-1;
 						break;
 					}
 					//if (!(int)temp)
-					//iptr = in.value-1;
-					break;
+					//iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::Load:
+			VMCASE(JumpIfNotLt)
 				{
-					stack.Push(vars[in.value]);
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					break;
+					if (!LessThan(two, one))
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::Store:
+			VMCASE(JumpIfNotGt)
 				{
-					auto temp = stack.Pop();
-					//store me
-					vars[in.value] = temp;
-					break;
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
+
+					if (!LessThan(one, two))
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::LLoad:
+			VMCASE(JumpIfNotLtE)
 				{
-					//printf("Load at: Stack Ptr: %d\n", sptr - localstack + in.value);
-					stack.Push(sptr[in.value]);
-					break;
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
+
+					if (!LessEqual(two, one))
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::LStore:
+			VMCASE(JumpIfNotGtE)
 				{
-					sptr[in.value] = stack.Pop();
-					//printf("Store at: Stack Ptr: %d\n", sptr - localstack + in.value);
-					break;
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
+
+					if (!LessEqual(one, two))
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::CLoad:
+			VMCASE(JumpIfNotEq)
 				{
-					auto frame = curframe;
-					int index = in.value2;
-					while ( index++ < 0)
-						frame = frame->prev;
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					if (frame->closed)
-						stack.Push(frame->cupvals[in.value]);
-					else
-						stack.Push(*frame->upvals[in.value]);
-					break;
+					if (one.IsInteger() && two.IsInteger() ? one.integer() != two.integer() : !(one == two))
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::CStore:
+			VMCASE(JumpIfEq)
 				{
-					auto frame = curframe;
-					int index = in.value2;
-					while ( index++ < 0)
-						frame = frame->prev;
-
-					//write barrier
-					if (frame->grey == true)
-					{
-						frame->mark = false;
-						gc.greys.Push(frame);
-					}
+					Value& one = stack.PopUnchecked();
+					Value& two = stack.PopUnchecked();
 
-					if (frame->closed)
-						frame->cupvals[in.value] = stack.Pop();
-					else
-						*frame->upvals[in.value] = stack.Pop();
-					break;
+					if (one.IsInteger() && two.IsInteger() ? one.integer() == two.integer() : one == two)
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::LoadFunction:
+			VMCASE(Load)
 				{
-					//construct a new closure with the right number of upvalues
-					//from the Func* object
-					Closure* closure = new Closure;
-					closure->grey = closure->mark = false;
-					closure->prev = curframe;
-					closure->numupvals = in.func->upvals;
-					closure->closed = false;
-					if (in.func->upvals)
-						closure->upvals = new Value*[in.func->upvals];
-					closure->prototype = in.func;
-					gc.closures.push_back(closure);
-					stack.Push(Value(closure));
-
-					if (gc.allocationCounter++%GC_INTERVAL == 0)
-						this->RunGC();
+					stack.PushUnchecked(vars[in->value]);
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::CInit:
+			VMCASE(Store)
+				{
+					auto temp = stack.PopUnchecked();
+					gc.Shade(temp);//write barrier
+					//store me
+					vars[in->value] = temp;
+					VMNEXT();
+				}
+			VMCASE(LLoad)
+				{
+					//printf("Load at: Stack Ptr: %d\n", sptr - localstack + in->value);
+					stack.PushUnchecked(sptr[in->value]);
+					VMNEXT();
+				}
+			VMCASE(LStore)
+				{
+					sptr[in->value] = stack.PopUnchecked();
+					gc.Shade(sptr[in->value]);//write barrier
+					//printf("Store at: Stack Ptr: %d\n", sptr - localstack + in->value);
+					VMNEXT();
+				}
+			VMCASE(CLoad)
+				{
+					stack.PushUnchecked(*curframe->upvals[in->value]->v);
+					VMNEXT();
+				}
+			VMCASE(CStore)
 				{
-					//whelp
-					curframe->upvals[(unsigned int)in.value2] = &sptr[in.value];
+					auto upvalue = curframe->upvals[in->value];
+					*upvalue->v = stack.PopUnchecked();
 
-					break;
+					//write barrier
+					gc.Remember(Value(upvalue));
+					VMNEXT();
 				}
-			case InstructionType::Close:
+			VMCASE(LoadFunction)
 				{
-					auto cur = curframe;
-					if (cur && cur->numupvals && cur->closed == false)
+					//construct a new closure, sharing the upvalues of locals that were already captured
+					Function* func = in->func;
+					Closure* closure = gc.NewClosure(func);
+					for (unsigned int i = 0; i < func->upvals; i++)
 					{
-						auto tmp = new Value[cur->numupvals];
-						for (int i = 0; i < cur->numupvals; i++)
-							tmp[i] = *cur->upvals[i];
-
-						delete[] cur->upvals;
-						cur->closed = true;
-						cur->cupvals = tmp;
+						const Capture& capture = func->captures[i];
+						closure->upvals[i] = capture.local ? this->FindUpvalue(&sptr[capture.index]) : curframe->upvals[capture.index];
 					}
+					stack.PushUnchecked(Value(closure));
 
-					break;
+					if (gc.Due())
+						this->gc.Collect();
+
+					VMNEXT();
 				}
-			case InstructionType::Call:
+			VMCASE(Close)
+				{
+					this->Close(sptr);
+					VMNEXT();
+				}
+			VMCASE(Call)
 				{
 					//allocate capture area here
-					if (vars[in.value].type == ValueType::Function)
+					if (vars[in->value].type() == ValueType::Function)
 					{
 						//store iptr on call stack
 						if (fptr > JET_MAX_CALLDEPTH)
@@ -881,75 +1418,27 @@ Value JetContext::Execute(int iptr)
 
 						this->sptr += curframe->prototype->locals;
 
-						if ((sptr - localstack) >= JET_STACK_SIZE)
+						if ((sptr - localstack) + vars[in->value]._function()->prototype->locals > JET_STACK_SIZE)
 							throw RuntimeException("Stack Overflow!");
 
-						curframe = vars[in.value]._function;
-
-						if (curframe->closed)
-						{
-							//allocate new local frame here
-							Closure* closure = new Closure;
-							closure->grey = closure->mark = false;
-							closure->prev = curframe->prev;
-							closure->numupvals = curframe->numupvals;//in.func->upvals;
-							closure->closed = false;
-							if (closure->numupvals)
-								closure->upvals = new Value*[closure->numupvals];
-							closure->prototype = curframe->prototype;//in.func;
-							this->gc.closures.push_back(closure);
-
-							curframe = closure;
-
-							if (gc.allocationCounter++%GC_INTERVAL == 0)
-								this->RunGC();
-						}
+						curframe = vars[in->value]._function();
 						//printf("Call: Stack Ptr At: %d\n", sptr - localstack);
 
 						Function* func = curframe->prototype;
-						//set all the locals
-						if ((unsigned int)in.value2 <= func->args)
-						{
-							for (int i = func->args-1; i >= 0; i--)
-							{
-								if (i < (int)in.value2)
-									sptr[i] = stack.Pop();
-								else
-									sptr[i] = Value();
-							}
-						}
-						else if (func->vararg)
-						{
-							sptr[func->locals-1] = this->NewArray();
-							auto arr = sptr[func->locals-1]._array->ptr;
-							arr->resize(in.value2 - func->args);
-							for (int i = (int)in.value2-1; i >= 0; i--)
-							{
-								if (i < func->args)
-									sptr[i] = stack.Pop();
-								else
-									(*arr)[i] = stack.Pop();
-							}
-						}
-						else
-						{
-							for (int i = (int)in.value2-1; i >= 0; i--)
-							{
-								if (i < func->args)
-									sptr[i] = stack.Pop();//frames[fptr].locals[i] = stack.Pop();
-								else
-									stack.Pop();
-							}
-						}
+						this->PopArguments(func, (unsigned int)in->value2);
+
+						//the verifier worked out how deep the function goes, nothing in it checks again
+						if (stack.headroom() < func->maxstack)
+							throw RuntimeException("Stack overflow");
 
 						//go to function
 						iptr = func->ptr-1;
 					}
-					else if (vars[in.value].type == ValueType::NativeFunction)
+					else if (vars[in->value].type() == ValueType::NativeFunction)
 					{
-						unsigned int args = (unsigned int)in.value2;
+						unsigned int args = (unsigned int)in->value2;
 						Value* tmp = &stack.mem[stack.size()-args];
-						stack.QuickPop(args);//pop off args
+						stack.QuickPopUnchecked(args);//pop off args
 
 						//ok fix this to be cleaner and resolve stack printing
 						//should just push a value to indicate that we are in a native function call
@@ -957,34 +1446,41 @@ Value JetContext::Execute(int iptr)
 						callstack.Push(std::pair<unsigned int, Closure*>(123456789, curframe));//callstack.Push(123456789);
 						//to return something, push it to the stack
 						int s = stack.size();
-						(*vars[in.value].func)(this,tmp,args);
+						(*vars[in->value].func())(this,tmp,args);
 
 						callstack.QuickPop(2);
 						if (stack.size() == s)//we didnt return anything
-							stack.Push(Value());//return null
+							stack.PushUnchecked(Value());//return null
+						else if (stack.size() > s + 1)//verified code counts on exactly one result
+							stack.QuickPopUnchecked(stack.size() - s - 1);
+
+						//natives dont check after they allocate, things like strings can build up in them
+						if (gc.Due())
+							this->gc.Collect();
 					}
 					else
 					{
-						//find the variable name from the in.value which is the index into the variable array
+						//find the variable name from the in->value which is the index into the variable array
 						std::string var;
 						for (auto ii: variables)
 						{
-							if (ii.second == in.value)
+							if (ii.second == in->value)
 							{
 								var = ii.first;
 								break;
 							}
 						}
-						throw RuntimeException("Cannot call non function '" + var + " of type " + vars[(int)in.value].Type() + "'!!!");
+						throw RuntimeException("Cannot call non function '" + var + " of type " + vars[(int)in->value].Type() + "'!!!");
 					}
 
-					break;
+					VMNEXT();
 				}
-			case InstructionType::ECall:
+			VMCASE(ECall)
 				{
 					//allocate capture area here
-					Value fun = stack.Pop();
-					if (fun.type == ValueType::Function)
+					fun = stack.PopUnchecked();
+invoke:
+					if (fun.type() == ValueType::Function)
 					{
 						if (fptr > JET_MAX_CALLDEPTH)
 							throw RuntimeException("Exceeded Max Call Depth!");
@@ -995,75 +1491,26 @@ Value JetContext::Execute(int iptr)
 
 						sptr += curframe->prototype->locals;
 
-						if ((sptr - localstack) >= JET_STACK_SIZE)
+						if ((sptr - localstack) + fun._function()->prototype->locals > JET_STACK_SIZE)
 							throw RuntimeException("Stack Overflow!");
 
-						curframe = fun._function;
-
-						if (curframe->closed)
-						{
-							//allocate new local frame here
-							Closure* closure = new Closure;
-							closure->grey = closure->mark = false;
-							closure->prev = curframe->prev;
-							closure->numupvals = closure->numupvals;
-							closure->closed = false;
-							if (closure->numupvals)
-								closure->upvals = new Value*[closure->numupvals];
-							closure->prototype = curframe->prototype;
-							this->gc.closures.push_back(closure);
-
-							curframe = closure;
-
-							if (gc.allocationCounter++%GC_INTERVAL == 0)
-								this->RunGC();
-						}
+						curframe = fun._function();
 						//printf("ECall: Stack Ptr At: %d\n", sptr - localstack);
 
 						Function* func = curframe->prototype;
-						//set all the locals
-						if (in.value <= func->args)
-						{
-							for (int i = func->args-1; i >= 0; i--)
-							{
-								if (i < in.value)
-									sptr[i] = stack.Pop();
-								else
-									sptr[i] = Value();
-							}
-						}
-						else if (func->vararg)
-						{
-							sptr[func->locals-1] = this->NewArray();
-							auto arr = sptr[func->locals-1]._array->ptr;
-							arr->resize(in.value2 - func->args);
-							for (int i = (int)in.value2-1; i >= 0; i--)
-							{
-								if (i < func->args)
-									sptr[i] = stack.Pop();
-								else
-									(*arr)[i] = stack.Pop();
-							}
-						}
-						else
-						{
-							for (int i = in.value-1; i >= 0; i--)
-							{
-								if (i < func->args)
-									sptr[i] = stack.Pop();//frames[fptr].locals[i] = stack.Pop();
-								else
-									stack.Pop();
-							}
-						}
+						this->PopArguments(func, in->value);
+
+						if (stack.headroom() < func->maxstack)
+							throw RuntimeException("Stack overflow");
 
 						//go to function
-						iptr = fun._function->prototype->ptr-1;
+						iptr = fun._function()->prototype->ptr-1;
 					}
-					else if (fun.type == ValueType::NativeFunction)
+					else if (fun.type() == ValueType::NativeFunction)
 					{
-						unsigned int args = (unsigned int)in.value;
+						unsigned int args = (unsigned int)in->value;
 						Value* tmp = &stack.mem[stack.size()-args];
-						stack.QuickPop(args);//pop off args
+						stack.QuickPopUnchecked(args);//pop off args
 
 						//ok fix this to be cleaner and resolve stack printing
 						//should just push a value to indicate that we are in a native function call
@@ -1072,20 +1519,67 @@ Value JetContext::Execute(int iptr)
 						
 						//to return something, push it to the stack
 						int s = stack.size();
-						(*fun.func)(this,tmp,args);
+						(*fun.func())(this,tmp,args);
 
 						callstack.QuickPop(2);
 						if (stack.size() == s)//we didnt return anything
-							stack.Push(Value());//return null
+							stack.PushUnchecked(Value());//return null
+						else if (stack.size() > s + 1)//verified code counts on exactly one result
+							stack.QuickPopUnchecked(stack.size() - s - 1);
+
+						//natives dont check after they allocate, things like strings can build up in them
+						if (gc.Due())
+							this->gc.Collect();
 					}
 					else
 					{
 						throw RuntimeException("Cannot call non function type " + std::string(fun.Type()) + "!!!");
 					}
-					break;
+					VMNEXT();
+				}
+			VMCASE(TailCall)
+				{
+					fun = stack.PopUnchecked();
+tailinvoke:
+					//natives get an ordinary call, the return after this finishes the job
+					if (fun.type() != ValueType::Function)
+						goto invoke;
+
+					//the callee takes over this frame instead of getting one of its own, so the call stack doesnt grow
+					//its locals are about to be overwritten, closures that captured them get their own copies first
+					if (this->openupvals && this->openupvals->v >= sptr)
+						this->Close(sptr);
+
+					Function* func = fun._function()->prototype;
+					if ((sptr - localstack) + func->locals > JET_STACK_SIZE)
+						throw RuntimeException("Stack Overflow!");
+
+					curframe = fun._function();
+					this->PopArguments(func, in->value);
+
+					if (stack.headroom() < func->maxstack)
+						throw RuntimeException("Stack overflow");
+
+					iptr = func->ptr-1;
+					VMNEXT();
+				}
+			VMCASE(Invoke)
+				{
+					//self is the last argument and already in place, only the method has to be found
+					fun = this->GetCachedMethod(stack.Peek(), _JetInternedString::Get(in->string), in->cache);
+					goto invoke;
+				}
+			VMCASE(TailInvoke)
+				{
+					fun = this->GetCachedMethod(stack.Peek(), _JetInternedString::Get(in->string), in->cache);
+					goto tailinvoke;
 				}
-			case InstructionType::Return:
+			VMCASE(Return)
 				{
+					//locals that were captured go out of scope
+					if (this->openupvals && this->openupvals->v >= sptr)
+						this->Close(sptr);
+
 					auto oframe = callstack.Pop();//iptr = callstack.Pop();
 					iptr = oframe.first;
 					sptr -= oframe.second->prototype->locals;//curframe->prototype->locals;
@@ -1093,183 +1587,386 @@ Value JetContext::Execute(int iptr)
 					curframe = oframe.second;
 
 					fptr--;
-					break;
+					VMCHECKEDNEXT();
 				}
-			case InstructionType::Dup:
+			VMCASE(Dup)
 				{
-					stack.Push(stack.Peek());
-					break;
+					stack.PushUnchecked(stack.Peek());
+					VMNEXT();
 				}
-			case InstructionType::Pop:
+			VMCASE(Pop)
 				{
-					stack.Pop();
-					break;
+					stack.PopUnchecked();
+					VMNEXT();
 				}
-			case InstructionType::StoreAt:
+			VMCASE(StoreAt)
 				{
-					if (in.string)
+					if (in->string)
 					{
-						Value loc = stack.Pop();
-						Value val = stack.Pop();	
+						Value loc = stack.PopUnchecked();
+						Value val = stack.PopUnchecked();	
 
-						if (loc.type == ValueType::Object)
-							(*loc._object->ptr)[in.string] = val;
+						if (loc.type() == ValueType::Object)
+							this->SetCachedMember(loc._object(), _JetInternedString::Get(in->string), val, in->cache);
 						else
 							throw RuntimeException("Could not index a non array/object value!");
 
-						if (loc._object->mark)
-						{
-							//reset to grey and push back for reprocessing
-							//printf("write barrier triggered!\n");
-							loc._object->mark = false;
-							gc.greys.Push(loc);//push to grey stack
-						}
 						//write barrier
+						gc.Remember(loc);
 					}
 					else
 					{
-						Value index = stack.Pop();
-						Value loc = stack.Pop();
-						Value val = stack.Pop();	
+						Value index = stack.PopUnchecked();
+						Value loc = stack.PopUnchecked();
+						Value val = stack.PopUnchecked();	
 
-						if (loc.type == ValueType::Array)
+						if (loc.type() == ValueType::Array)
 						{
 							//gc bug apparant in benchmark.txt.txt fixme
-							if ((int)index >= loc._array->ptr->size() || (int)index < 0)
+							if ((int)index >= loc._array()->ptr->size() || (int)index < 0)
 								throw RuntimeException("Array index out of range!");
-							(*loc._array->ptr)[(int)index] = val;
+							(*loc._array()->ptr)[(int)index] = val;
 
 							//write barrier
-							if (loc._array->mark)
-							{
-								//reset to grey and push back for reprocessing
-								//printf("write barrier triggered!\n");
-								loc._array->mark = false;
-								gc.greys.Push(loc);//push to grey stack
-							}
+							gc.Remember(loc);
 						}
-						else if (loc.type == ValueType::Object)
+						else if (loc.type() == ValueType::Object)
 						{
-							(*loc._object->ptr)[index] = val;
-
-							//write barrier
-							if (loc._object->mark)
+							//objects that get new string keys this way are being used like maps
+							//integer keys go in the array part when they can and dont need that
+							Value* slot = loc._object()->ptr->Find(index);
+							if (slot)
+								*slot = val;
+							else
 							{
-								//reset to grey and push back for reprocessing
-								//printf("write barrier triggered!\n");
-								loc._object->mark = false;
-								gc.greys.Push(loc);//push to grey stack
+								if (index.type() == ValueType::String)
+									loc._object()->ptr->ToDictionary();
+								(*loc._object()->ptr)[index] = val;
 							}
+
+							//write barrier
+							gc.Remember(loc);
 						}
 						else
 							throw RuntimeException("Could not index a non array/object value!");
 						//write barrier
 					}
-					break;
+					VMNEXT();
 				}
-			case InstructionType::LoadAt:
+			VMCASE(LoadAt)
 				{
-					if (in.string)
+					if (in->string)
 					{
-						Value loc = stack.Pop();
-						//add metamethods
-						if (loc.type == ValueType::Object)
-						{
-							Value v;
-							auto ii = loc._object->ptr->find(in.string);
-							if (ii == loc._object->ptr->end())
-							{
-								if (loc.prototype)
-								{
-									ii = loc.prototype->ptr->find(in.string);
-									if (ii == loc.prototype->ptr->end())
-									{
-										ii = this->object.ptr->find(in.string);
-										if (ii != this->object.ptr->end())
-											v = ii->second;
-									}
-									else
-										v = ii->second;
-								}
-								else
-								{
-									ii = this->object.ptr->find(in.string);
-									if (ii != this->object.ptr->end())
-										v = ii->second;
-								}
-								stack.Push(v);
-							}
-							else
-								stack.Push(ii->second);
-							//Value v = (*loc._object->ptr)[in.string];
-
-							//check meta table
-							//if (v.type == ValueType::Null && loc.prototype)
-							//v = (*loc.prototype->ptr)[in.string];
-							//if (v.type == ValueType::Null)
-							//v = (*this->object.ptr)[in.string];
-							//stack.Push(v);
-						}
-						else if (loc.type == ValueType::String)
-							stack.Push((*this->string.ptr)[in.string]);
-						else if (loc.type == ValueType::Array)
-							stack.Push((*this->Array.ptr)[in.string]);
-						else if (loc.type == ValueType::Userdata)
-							stack.Push((*loc.prototype->ptr)[in.string]);
+						Value loc = stack.PopUnchecked();
+						Value key = _JetInternedString::Get(in->string);
+						Value* slot;
+						if (loc.type() == ValueType::Object && (slot = this->GetCachedMember(loc._object(), key, in->cache)))
+							stack.PushUnchecked(*slot);
 						else
-							throw RuntimeException("Could not index a non array/object value!");
+							stack.PushUnchecked(this->GetMember(loc, key));
 					}
 					else
 					{
-						Value index = stack.Pop();
-						Value loc = stack.Pop();
+						Value index = stack.PopUnchecked();
+						Value loc = stack.PopUnchecked();
 
-						if (loc.type == ValueType::Array)
+						if (loc.type() == ValueType::Array)
 						{
-							if ((int)index >= loc._array->ptr->size())
+							if ((int)index >= loc._array()->ptr->size())
 								throw RuntimeException("Array index out of range!");
-							stack.Push((*loc._array->ptr)[(int)index]);
+							stack.PushUnchecked((*loc._array()->ptr)[(int)index]);
+						}
+						else if (loc.type() == ValueType::Object)
+						{
+							//reading a key that isnt there gives null without adding it
+							Value* slot = loc._object()->ptr->Find(index);
+							stack.PushUnchecked(slot ? *slot : Value());
 						}
-						else if (loc.type == ValueType::Object)
-							stack.Push((*loc._object->ptr)[index]);
 						else
 							throw RuntimeException("Could not index a non array/object value!");
 					}
-					break;
+					VMNEXT();
 				}
-			case InstructionType::NewArray:
+			VMCASE(IterPrep)
 				{
-					auto arr = new GCVal<std::vector<Value>*>(new std::vector<Value>(in.value));//new std::map<int, Value>;
-					arr->grey = arr->mark = false;
-					this->gc.arrays.push_back(arr);
-					for (int i = in.value-1; i >= 0; i--)
-						(*arr->ptr)[i] = stack.Pop();
-					stack.Push(Value(arr));
+					//arrays and objects are walked by position without allocating anything
+					//userdata give an iterator that goes through getIterator, current and advance
+					Value* iter = &sptr[in->value];
+					iter[0] = stack.PopUnchecked();
+					iter[1] = Value(0);
+					if (iter[0].type() == ValueType::Userdata)
+					{
+						this->CallIterator(iter[0], "getIterator", iptr);
+						iter[0] = stack.PopUnchecked();
 
-					if (gc.allocationCounter++%GC_INTERVAL == 0)
-						this->RunGC();
+						if (gc.Due())
+							this->gc.Collect();
+					}
+					else if (iter[0].type() != ValueType::Array && iter[0].type() != ValueType::Object)
+						throw RuntimeException("Cannot iterate over a non array/object value!");
+					VMNEXT();
+				}
+			VMCASE(IterNext)
+				{
+					Value* iter = &sptr[(int)in->value2];
+					long long pos = iter[1].integer();
+					if (iter[0].type() == ValueType::Array)
+					{
+						//checked every time, the loop can change the size
+						if (pos < (long long)iter[0]._array()->ptr->size())
+						{
+							iter[1] = Value(pos+1);
+							stack.PushUnchecked((*iter[0]._array()->ptr)[(size_t)pos]);
+							VMNEXT();
+						}
+					}
+					else if (iter[0].type() == ValueType::Object)
+					{
+						if (pos < (long long)iter[0]._object()->ptr->size())
+						{
+							iter[1] = Value(pos+1);
+							stack.PushUnchecked((*_JetObjectBacking::iterator(iter[0]._object()->ptr, (unsigned int)pos)).second);
+							VMNEXT();
+						}
+					}
+					else
+					{
+						//a new iterator is already on the first element
+						bool more = true;
+						if (pos > 0)
+						{
+							this->CallIterator(iter[0], "advance", iptr);
+							Value r = stack.PopUnchecked();
+							more = !(r.type() == ValueType::Null || (r.IsInteger() && r.integer() == 0) || (r.IsNumber() && r.value() == 0.0));
+						}
+						if (more)
+						{
+							iter[1] = Value(pos+1);
+							this->CallIterator(iter[0], "current", iptr);
 
-					break;
+							if (gc.Due())
+								this->gc.Collect();
+							VMNEXT();
+						}
+					}
+					iptr = in->value-1;
+					VMNEXT();
+				}
+			VMCASE(IterKey)
+				{
+					//positions are one past the element by now
+					Value* iter = &sptr[in->value];
+					long long pos = iter[1].integer() - 1;
+					if (iter[0].type() == ValueType::Array)
+						stack.PushUnchecked(Value(pos));
+					else if (iter[0].type() == ValueType::Object)
+						stack.PushUnchecked((*_JetObjectBacking::iterator(iter[0]._object()->ptr, (unsigned int)pos)).first);
+					else
+					{
+						this->CallIterator(iter[0], "key", iptr);
+
+						if (gc.Due())
+							this->gc.Collect();
+					}
+					VMNEXT();
+				}
+			VMCASE(ForRangePrep)
+				{
+					//counts in integers if both ends are, otherwise in doubles
+					Value* range = &sptr[(int)in->value2];
+					Value& end = stack.PopUnchecked();
+					Value& start = stack.PopUnchecked();
+					if (start.IsInteger() && end.IsInteger())
+					{
+						range[1] = start;
+						range[2] = end;
+					}
+					else if ((start.IsInteger() || start.IsNumber()) && (end.IsInteger() || end.IsNumber()))
+					{
+						range[1] = Value((double)start);
+						range[2] = Value((double)end);
+					}
+					else
+						throw RuntimeException("Cannot count over a range that isnt numbers!");
+
+					range[0] = range[1];
+					if (range[1].IsInteger() ? range[1].integer() >= range[2].integer() : !(range[1].value() < range[2].value()))
+						iptr = in->value-1;
+					VMNEXT();
 				}
-			case InstructionType::NewObject:
+			VMCASE(ForRangeLoop)
 				{
-					auto obj = new _JetObject(new _JetObjectBacking);
-					obj->grey = obj->mark = false;
-					this->gc.objects.push_back(obj);
-					for (int i = in.value-1; i >= 0; i--)
+					//the variable is made from the new count rather than copied from the counter, copying right after the store is slow
+					Value* range = &sptr[(int)in->value2];
+					if (range[1].IsInteger())
+					{
+						long long i = range[1].integer() + 1;
+						if (i < range[2].integer())
+						{
+							range[1] = Value(i);
+							range[0] = Value(i);
+							iptr = in->value-1;
+						}
+					}
+					else
 					{
-						auto value = stack.Pop();
-						auto key = stack.Pop();
-						(*obj->ptr)[key] = value;
+						double d = range[1].value() + 1.0;
+						if (d < range[2].value())
+						{
+							range[1] = Value(d);
+							range[0] = Value(d);
+							iptr = in->value-1;
+						}
 					}
-					stack.Push(Value(obj));
+					VMNEXT();
+				}
+			VMCASE(NewArray)
+				{
+					auto arr = this->gc.NewArray(in->value);
+					for (int i = in->value-1; i >= 0; i--)
+						(*arr->ptr)[i] = stack.PopUnchecked();
+					stack.PushUnchecked(Value(arr));
 
-					if (gc.allocationCounter++%GC_INTERVAL == 0)
-						this->RunGC();
+					//write barrier, it is already black if the collector is in the middle of marking
+					if (in->value)
+						gc.Remember(Value(arr));
 
-					break;
+					if (gc.Due())
+						this->gc.Collect();
+
+					VMNEXT();
+				}
+			VMCASE(NewObject)
+				{
+					auto obj = this->gc.NewObject(this->rootshape);
+
+					//keys and values are interleaved on the stack in the order they were written
+					if (in->value)
+					{
+						Value* init = &stack.mem[stack.size()-in->value*2];
+						Shape* shape = in->shape;
+						bool same = shape && shape->keys.size() == in->value;
+						for (int i = 0; same && i < in->value; i++)
+							same = init[i*2].type() == ValueType::String && init[i*2]._string() == shape->keys[i]._string();
+
+						if (same)
+						{
+							//the keys come from the same string constants as last time, so they have the same shape
+							obj->ptr->SetShape(shape);
+							for (int i = 0; i < in->value; i++)
+								obj->ptr->GetSlot(i) = init[i*2+1];
+						}
+						else
+						{
+							for (int i = 0; i < in->value; i++)
+								(*obj->ptr)[init[i*2]] = init[i*2+1];
+							ins[iptr].shape = obj->ptr->GetShape();
+						}
+						stack.QuickPopUnchecked(in->value*2);
+						gc.Account(in->value*sizeof(Value));
+
+						//write barrier
+						gc.Remember(Value(obj));
+					}
+					stack.PushUnchecked(Value(obj));
+
+					if (gc.Due())
+						this->gc.Collect();
+
+					VMNEXT();
+				}
+			VMCASE(RAdd)
+				{
+					Value one = sptr[in->b];
+					Value two = sptr[in->c];
+					if (JET_LIKELY(one.IsInteger() && two.IsInteger()))
+						sptr[in->a] = Value(one.integer()+two.integer());
+					else
+						sptr[in->a] = one+two;
+					VMNEXT();
+				}
+			VMCASE(RSub)
+				{
+					Value one = sptr[in->b];
+					Value two = sptr[in->c];
+					if (JET_LIKELY(one.IsInteger() && two.IsInteger()))
+						sptr[in->a] = Value(one.integer()-two.integer());
+					else
+						sptr[in->a] = one-two;
+					VMNEXT();
+				}
+			VMCASE(RMul)
+				{
+					Value one = sptr[in->b];
+					Value two = sptr[in->c];
+					long long result;
+					if (one.IsInteger() && two.IsInteger() && IntegerMul(one.integer(), two.integer(), result))
+						sptr[in->a] = Value(result);
+					else
+						sptr[in->a] = one*two;
+					VMNEXT();
+				}
+			VMCASE(RDiv)
+				{
+					Value one = sptr[in->b];
+					Value two = sptr[in->c];
+					sptr[in->a] = one/two;
+					VMNEXT();
+				}
+			VMCASE(RModulus)
+				{
+					Value one = sptr[in->b];
+					Value two = sptr[in->c];
+					sptr[in->a] = one%two;
+					VMNEXT();
+				}
+			VMCASE(RMove)
+				{
+					sptr[in->a] = sptr[in->b];
+					VMNEXT();
+				}
+			VMCASE(LAddInt)
+				{
+					Value& one = sptr[in->value];
+					long long result;
+					if (JET_LIKELY(one.IsInteger()) && IntegerAdd(one.integer(), in->integer, result))
+						one = Value(result);
+					else
+						one = Value(in->integer)+one;
+					VMNEXT();
+				}
+			VMCASE(LSubInt)
+				{
+					Value& one = sptr[in->value];
+					long long result;
+					if (JET_LIKELY(one.IsInteger()) && IntegerSub(one.integer(), in->integer, result))
+						one = Value(result);
+					else
+						one = one-Value(in->integer);
+					VMNEXT();
+				}
+			VMCASE(LIncr)
+				{
+					Value& one = sptr[in->value];
+					if (JET_LIKELY(one.IsInteger()))
+						one = Value(one.integer()+1);
+					else
+						one = one+Value(1);
+					VMNEXT();
+				}
+			VMCASE(LDecr)
+				{
+					Value& one = sptr[in->value];
+					if (JET_LIKELY(one.IsInteger()))
+						one = Value(one.integer()-1);
+					else
+						one = one-Value(1);
+					VMNEXT();
 				}
 			default:
+#ifdef JET_THREADED_DISPATCH
+			op_Invalid:
+#endif
 				{
 					throw RuntimeException("Unimplemented Instruction!");
 				}
@@ -1277,6 +1974,12 @@ Value JetContext::Execute(int iptr)
 
 			iptr++;
 		}
+#ifdef JET_THREADED_DISPATCH
+vmexit:;
+#endif
+#undef VMCASE
+#undef VMNEXT
+#undef VMCHECKEDNEXT
 	}
 	catch(RuntimeException e)
 	{
@@ -1291,7 +1994,7 @@ Value JetContext::Execute(int iptr)
 			for (int i = 0; i < curframe->prototype->locals; i++)
 			{
 				Value v = this->sptr[i];
-				if (v.type >= ValueType(0))
+				if (v.type() >= ValueType(0))
 					printf("%d = %s\n", i, v.ToString().c_str());
 			}
 		}
@@ -1299,7 +2002,7 @@ Value JetContext::Execute(int iptr)
 		printf("\nVariables:\n");
 		for (auto ii: variables)
 		{
-			if (vars[ii.second].type != ValueType::Null)
+			if (vars[ii.second].type() != ValueType::Null)
 				printf("%s = %s\n", ii.first.c_str(), vars[ii.second].ToString().c_str());
 		}
 
@@ -1315,6 +2018,9 @@ Value JetContext::Execute(int iptr)
 		//reset fptr
 		fptr = -1;
 
+		//closures made before the error keep the values they captured
+		this->Close(this->localstack);
+
 		//clear the stacks
 		this->callstack.QuickPop(this->callstack.size()-startcallstack);
 		this->stack.QuickPop(this->stack.size()-startstack);
@@ -1340,6 +2046,7 @@ Value JetContext::Execute(int iptr)
 		}
 
 		//ok, need to properly roll back callstack
+		this->Close(this->localstack);
 		this->callstack.QuickPop(this->callstack.size()-startcallstack);
 		this->stack.QuickPop(this->stack.size()-startstack);
 
@@ -1434,6 +2141,234 @@ void JetContext::StackTrace(int curiptr)
 	}
 }
 
+void JetContext::Verify(Function* func, unsigned int end)
+{
+	//the entry point is run by Execute, which is fine with it leaving nothing behind
+	bool entry = func->name == "{Entry Point}";
+
+	std::vector<int> depths(end - func->ptr, -1);//at the start of each instruction, -1 if no path gets there
+	std::vector<unsigned int> work;
+	unsigned int maxstack = 0;
+
+	auto fail = [this, func](unsigned int i, const std::string& reason)
+	{
+		std::string file;
+		unsigned int line;
+		this->GetCode(i, file, line);
+		throw CompilerException(file, line, "Verifier rejected function '" + func->name + "' at instruction " + std::to_string(i - func->ptr) + ": " + reason);
+	};
+	auto flow = [&](unsigned int from, unsigned int to, int depth)
+	{
+		if (to < func->ptr || to >= end)
+			fail(from, "control leaves the function without returning");
+
+		int& seen = depths[to - func->ptr];
+		if (seen < 0)
+		{
+			seen = depth;
+			work.push_back(to);
+		}
+		else if (seen != depth)
+			fail(to, "reached with different stack depths");
+	};
+
+	flow(func->ptr, func->ptr, 0);
+	while (work.size())
+	{
+		unsigned int i = work.back();
+		work.pop_back();
+
+		const Instruction& in = this->ins[i];
+		int depth = depths[i - func->ptr];
+		int pops = 0, pushes = 0, peak = depth;
+		bool next = true;
+		switch (in.instruction)
+		{
+		case InstructionType::Add:
+		case InstructionType::Mul:
+		case InstructionType::Div:
+		case InstructionType::Sub:
+		case InstructionType::Modulus:
+		case InstructionType::BAnd:
+		case InstructionType::BOr:
+		case InstructionType::Xor:
+		case InstructionType::LeftShift:
+		case InstructionType::RightShift:
+		case InstructionType::Eq:
+		case InstructionType::NotEq:
+		case InstructionType::Lt:
+		case InstructionType::Gt:
+		case InstructionType::LtE:
+		case InstructionType::GtE:
+			pops = 2;
+			pushes = 1;
+			break;
+		case InstructionType::Negate:
+		case InstructionType::BNot:
+		case InstructionType::Incr:
+		case InstructionType::Decr:
+			pops = 1;
+			pushes = 1;
+			break;
+		case InstructionType::Dup:
+			pops = 1;
+			pushes = 2;
+			break;
+		case InstructionType::Pop:
+		case InstructionType::Store:
+			pops = 1;
+			break;
+		case InstructionType::LdNum:
+		case InstructionType::LdInt:
+		case InstructionType::LdNull:
+		case InstructionType::LdStr:
+		case InstructionType::Load:
+			pushes = 1;
+			break;
+		case InstructionType::LoadFunction:
+			if (in.func == 0)
+				fail(i, "loads a function that doesnt exist");
+			pushes = 1;
+			break;
+		case InstructionType::LLoad:
+		case InstructionType::LStore:
+		case InstructionType::LAddInt:
+		case InstructionType::LSubInt:
+		case InstructionType::LIncr:
+		case InstructionType::LDecr:
+			if ((unsigned int)in.value >= func->locals)
+				fail(i, "uses a local that doesnt exist");
+			if (in.instruction == InstructionType::LLoad)
+				pushes = 1;
+			else if (in.instruction == InstructionType::LStore)
+				pops = 1;
+			break;
+		case InstructionType::RAdd:
+		case InstructionType::RSub:
+		case InstructionType::RMul:
+		case InstructionType::RDiv:
+		case InstructionType::RModulus:
+		case InstructionType::RMove:
+			if (in.a >= func->locals || in.b >= func->locals || (in.instruction != InstructionType::RMove && in.c >= func->locals))
+				fail(i, "uses a local that doesnt exist");
+			break;
+		case InstructionType::CLoad:
+		case InstructionType::CStore:
+			if ((unsigned int)in.value >= func->upvals)
+				fail(i, "uses an upvalue that doesnt exist");
+			if (in.instruction == InstructionType::CLoad)
+				pushes = 1;
+			else
+				pops = 1;
+			break;
+		case InstructionType::Close:
+			break;
+		case InstructionType::Jump:
+			flow(i, in.value, depth);
+			next = false;
+			break;
+		case InstructionType::JumpTrue:
+		case InstructionType::JumpFalse:
+			if (depth < 1)
+				fail(i, "pops more than is on the stack");
+			flow(i, in.value, depth - 1);
+			pops = 1;
+			break;
+		case InstructionType::JumpIfNotLt:
+		case InstructionType::JumpIfNotGt:
+		case InstructionType::JumpIfNotLtE:
+		case InstructionType::JumpIfNotGtE:
+		case InstructionType::JumpIfNotEq:
+		case InstructionType::JumpIfEq:
+			if (depth < 2)
+				fail(i, "pops more than is on the stack");
+			flow(i, in.value, depth - 2);
+			pops = 2;
+			break;
+		case InstructionType::IterPrep:
+			if ((unsigned int)in.value + 1 >= func->locals)
+				fail(i, "uses a local that doesnt exist");
+			pops = 1;
+			break;
+		case InstructionType::IterNext:
+			//pushes the element when it keeps going, leaves the stack as it was when it jumps
+			if ((unsigned int)(int)in.value2 + 1 >= func->locals)
+				fail(i, "uses a local that doesnt exist");
+			flow(i, in.value, depth);
+			pushes = 1;
+			break;
+		case InstructionType::IterKey:
+			if ((unsigned int)in.value + 1 >= func->locals)
+				fail(i, "uses a local that doesnt exist");
+			pushes = 1;
+			break;
+		case InstructionType::ForRangePrep:
+		case InstructionType::ForRangeLoop:
+			if ((unsigned int)(int)in.value2 + 2 >= func->locals)
+				fail(i, "uses a local that doesnt exist");
+			if (in.instruction == InstructionType::ForRangePrep)
+			{
+				if (depth < 2)
+					fail(i, "pops more than is on the stack");
+				pops = 2;
+			}
+			flow(i, in.value, depth - pops);
+			break;
+		case InstructionType::NewArray:
+			pops = in.value;
+			pushes = 1;
+			break;
+		case InstructionType::NewObject:
+			pops = in.value*2;
+			pushes = 1;
+			break;
+		case InstructionType::LoadAt:
+			pops = in.string ? 1 : 2;
+			pushes = 1;
+			break;
+		case InstructionType::StoreAt:
+			pops = in.string ? 2 : 3;
+			break;
+		case InstructionType::Call:
+			pops = (int)in.value2;
+			pushes = 1;
+			break;
+		case InstructionType::ECall:
+		case InstructionType::TailCall:
+			pops = in.value + 1;
+			pushes = 1;
+			break;
+		case InstructionType::Invoke:
+		case InstructionType::TailInvoke:
+			//self is one of the arguments, the method is never pushed
+			if (in.value < 1)
+				fail(i, "calls a method without self");
+			if (in.string == 0)
+				fail(i, "calls a method without a name");
+			pops = in.value;
+			pushes = 1;
+			break;
+		case InstructionType::Return:
+			if (entry ? depth > 1 : depth != 1)
+				fail(i, "returns with " + std::to_string(depth) + " values on the stack");
+			next = false;
+			break;
+		default:
+			fail(i, "is not an instruction the vm runs");
+		}
+
+		if (pops < 0 || depth < pops)
+			fail(i, "pops more than is on the stack");
+		depth += pushes - pops;
+		peak = std::max(peak, depth);
+		maxstack = std::max(maxstack, (unsigned int)peak);
+
+		if (next)
+			flow(i, i + 1, depth);
+	}
+	func->maxstack = maxstack;
+}
+
 Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 {
 #ifdef JET_TIME_EXECUTION
@@ -1442,154 +2377,248 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 	QueryPerformanceCounter( (LARGE_INTEGER *)&start );
 #endif
 
-	for (auto inst: code)
+	//if anything goes wrong the context is left as it was, so nothing half assembled or unverified can run
+	size_t oldins = this->ins.size(), olddebuginfo = this->debuginfo.size(), oldentrypoints = this->entrypoints.size();
+	int oldposition = this->labelposition;
+	std::vector<Function*> defined;//in the order their code is laid out
+	try
 	{
-		switch (inst.type)
+		Function* func = 0;//the last one defined, captures that follow belong to it
+		for (auto inst: code)
 		{
-		case InstructionType::Comment:
-			{
-				break;
-			}
-		case InstructionType::DebugLine:
+			switch (inst.type)
 			{
-				//this should contain line/file info
-				DebugInfo info;
-				info.file = inst.string;
-				info.line = inst.second;
-				info.code = this->labelposition;
-				this->debuginfo.push_back(info);
-				//push something into the array at the instruction pointer
-				delete[] inst.string;
-
-				break;
-			}
-		case InstructionType::Function:
-			{
-				//clear label array for each function
-				//labels.clear();
-
-				//do something with argument and local counts
-				Function* func = new Function;
-				func->args = inst.a;
-				func->locals = inst.b;
-				func->upvals = inst.c;
-				func->ptr = labelposition;
-				func->name = inst.string;
-				func->vararg = inst.d ? true : false;
-
-				if (functions.find(inst.string) == functions.end())
-					functions[inst.string] = func;
-				else if (strcmp(inst.string, "{Entry Point}") == 0)
-				{
-					//have to do something with old entry point because it leaks
-					entrypoints.push_back(functions[inst.string]);
-					functions[inst.string] = func;
+			case InstructionType::Comment:
+				{
+					break;
 				}
-				else
-					throw RuntimeException("ERROR: Duplicate Function Label Name: %s\n" + std::string(inst.string));
-
-				delete[] inst.string;
-				break;
-			}
-		case InstructionType::Label:
-			{
-				if (this->labels.find(inst.string) == labels.end())
+			case InstructionType::CInit:
+				{
+					Capture capture;
+					capture.local = inst.second != 0;
+					capture.index = inst.first;
+					func->captures.push_back(capture);
+					break;
+				}
+			case InstructionType::DebugLine:
 				{
-					this->labels[inst.string] = this->labelposition;
+					//this should contain line/file info
+					DebugInfo info;
+					info.file = inst.string;
+					info.line = inst.second;
+					info.code = this->labelposition;
+					this->debuginfo.push_back(info);
+					//push something into the array at the instruction pointer
 					delete[] inst.string;
+
+					break;
 				}
-				else
+			case InstructionType::Function:
 				{
+					//clear label array for each function
+					//labels.clear();
+
+					//do something with argument and local counts
+					func = new Function;
+					func->args = inst.a;
+					func->locals = inst.b;
+					func->upvals = inst.c;
+					func->ptr = labelposition;
+					func->name = inst.string;
+					func->vararg = inst.d ? true : false;
+					defined.push_back(func);
+
+					if (functions.find(inst.string) == functions.end())
+						functions[inst.string] = func;
+					else if (strcmp(inst.string, "{Entry Point}") == 0)
+					{
+						//have to do something with old entry point because it leaks
+						entrypoints.push_back(functions[inst.string]);
+						functions[inst.string] = func;
+					}
+					else
+						throw RuntimeException("ERROR: Duplicate Function Label Name: %s\n" + std::string(inst.string));
+
 					delete[] inst.string;
-					throw RuntimeException("ERROR: Duplicate Label Name: %s\n" + std::string(inst.string));
+					break;
+				}
+			case InstructionType::Label:
+				{
+					if (this->labels.find(inst.string) == labels.end())
+					{
+						this->labels[inst.string] = this->labelposition;
+						delete[] inst.string;
+					}
+					else
+					{
+						delete[] inst.string;
+						throw RuntimeException("ERROR: Duplicate Label Name: %s\n" + std::string(inst.string));
+					}
+					break;
+				}
+			default:
+				{
+					this->labelposition++;
 				}
-				break;
-			}
-		default:
-			{
-				this->labelposition++;
 			}
 		}
-	}
 
-	for (auto inst: code)
-	{
-		switch (inst.type)
+		for (auto inst: code)
 		{
-		case InstructionType::Comment:
-		case InstructionType::Function:
-		case InstructionType::Label:
-		case InstructionType::DebugLine:
+			switch (inst.type)
 			{
-				break;
-			}
-		default:
-			{
-				Instruction ins;
-				ins.instruction = inst.type;
-				ins.string = inst.string;
-				ins.value = inst.first;
-				ins.value2 = inst.second;
-
-				switch (inst.type)
+			case InstructionType::Comment:
+			case InstructionType::Function:
+			case InstructionType::CInit:
+			case InstructionType::Label:
+			case InstructionType::DebugLine:
+				{
+					break;
+				}
+			default:
 				{
-				case InstructionType::Call:
-				case InstructionType::Store:
-				case InstructionType::Load:
+					Instruction ins;
+					ins.instruction = inst.type;
+					ins.string = inst.string;
+					ins.value = inst.first;
+					ins.value2 = inst.second;
+					if (inst.type == InstructionType::LdInt || inst.type == InstructionType::LAddInt || inst.type == InstructionType::LSubInt)
+						ins.integer = (long long)inst.second;
+
+					switch (inst.type)
 					{
-						if (variables.find(inst.string) == variables.end())
+					case InstructionType::LoadAt:
+					case InstructionType::StoreAt:
+					case InstructionType::Invoke:
+					case InstructionType::TailInvoke:
 						{
-							//add it
-							variables[inst.string] = variables.size();
-							vars.push_back(Value());
+							if (inst.string)
+							{
+								ins.string = this->Intern(inst.string)._string();
+								delete[] inst.string;
+								ins.cache = new PropertyCache;
+							}
+							break;
+						}
+					case InstructionType::LdStr:
+						{
+							//string constants and property names are interned so they compare by pointer
+							ins.string = this->Intern(inst.string)._string();
+							delete[] inst.string;
+							break;
+						}
+					case InstructionType::NewObject:
+						{
+							ins.shape = 0;
+							break;
+						}
+					case InstructionType::RAdd:
+					case InstructionType::RSub:
+					case InstructionType::RMul:
+					case InstructionType::RDiv:
+					case InstructionType::RModulus:
+					case InstructionType::RMove:
+						{
+							//register operands are packed into the second value
+							ins.a = inst.a;
+							ins.b = inst.b;
+							ins.c = inst.c;
+							break;
 						}
-						ins.value = variables[inst.string];
-						break;
-					}
-				case InstructionType::LoadFunction:
-					{
-						ins.func = functions[inst.string];
-						break;
 					}
-				case InstructionType::Jump:
-				case InstructionType::JumpFalse:
-				case InstructionType::JumpTrue:
+
+					switch (inst.type)
 					{
-						if (labels.find(inst.string) == labels.end())
-							throw RuntimeException("Label '" + (std::string)inst.string + "' does not exist!");
-						ins.value = labels[inst.string];
-						break;
+					case InstructionType::Call:
+					case InstructionType::Store:
+					case InstructionType::Load:
+						{
+							if (variables.find(inst.string) == variables.end())
+							{
+								//add it
+								variables[inst.string] = variables.size();
+								vars.push_back(Value());
+							}
+							ins.value = variables[inst.string];
+							break;
+						}
+					case InstructionType::LoadFunction:
+						{
+							ins.func = functions[inst.string];
+							break;
+						}
+					case InstructionType::Jump:
+					case InstructionType::JumpFalse:
+					case InstructionType::JumpTrue:
+					case InstructionType::JumpIfNotLt:
+					case InstructionType::JumpIfNotGt:
+					case InstructionType::JumpIfNotLtE:
+					case InstructionType::JumpIfNotGtE:
+					case InstructionType::JumpIfNotEq:
+					case InstructionType::JumpIfEq:
+					case InstructionType::IterNext:
+					case InstructionType::ForRangePrep:
+					case InstructionType::ForRangeLoop:
+						{
+							if (labels.find(inst.string) == labels.end())
+								throw RuntimeException("Label '" + (std::string)inst.string + "' does not exist!");
+							ins.value = labels[inst.string];
+							break;
+						}
 					}
-				}
 
-				this->ins.push_back(ins);
+					this->ins.push_back(ins);
+				}
 			}
 		}
-	}
 
 #ifdef JET_TIME_EXECUTION
-	QueryPerformanceCounter( (LARGE_INTEGER *)&end );
+		QueryPerformanceCounter( (LARGE_INTEGER *)&end );
 
-	INT64 diff = end - start;
-	double dt = ((double)diff)/((double)rate);
+		INT64 diff = end - start;
+		double dt = ((double)diff)/((double)rate);
 
-	printf("Took %lf seconds to assemble\n\n", dt);
+		printf("Took %lf seconds to assemble\n\n", dt);
 #endif
 
-	auto tmpframe = new Closure;
-	tmpframe->prev = 0;
-	//tmpframe->next = 0;
-	tmpframe->closed = false;
-	tmpframe->prototype = this->functions["{Entry Point}"];
-	tmpframe->numupvals = tmpframe->prototype->upvals;
-	if (tmpframe->numupvals)
-		tmpframe->upvals = new Value*[tmpframe->numupvals];
-	else
-		tmpframe->upvals = 0;
+		//each function's code runs up to where the next one starts
+		for (size_t i = 0; i < defined.size(); i++)
+			this->Verify(defined[i], i + 1 < defined.size() ? defined[i + 1]->ptr : (unsigned int)this->ins.size());
+	}
+	catch (...)
+	{
+		for (size_t i = oldins; i < this->ins.size(); i++)
+			FreeInstruction(this->ins[i]);
+		this->ins.resize(oldins);
+		this->debuginfo.resize(olddebuginfo);
 
-	this->curframe = tmpframe;
+		//labels are never shared between scripts, the new ones are all past where this one started
+		for (auto ii = this->labels.begin(); ii != this->labels.end(); )
+		{
+			if (ii->second >= (unsigned int)oldposition)
+				ii = this->labels.erase(ii);
+			else
+				ii++;
+		}
+		this->labelposition = oldposition;
 
-	gc.closures.push_back(tmpframe);
+		for (auto f: defined)
+		{
+			auto ii = this->functions.find(f->name);
+			if (ii != this->functions.end() && ii->second == f)
+				this->functions.erase(ii);
+			delete f;
+		}
+		if (this->entrypoints.size() > oldentrypoints)
+		{
+			this->functions["{Entry Point}"] = this->entrypoints[oldentrypoints];
+			this->entrypoints.resize(oldentrypoints);
+		}
+		throw;
+	}
+
+	auto tmpframe = gc.NewClosure(this->functions["{Entry Point}"]);
+	this->curframe = tmpframe;
 
 	Value temp = this->Execute(tmpframe->prototype->ptr);//run the static code
 	if (this->callstack.size() > 0)
@@ -1601,17 +2630,17 @@ Value JetContext::Assemble(const std::vector<IntermediateInstruction>& code)
 
 Value JetContext::Call(Value* fun, Value* args, unsigned int numargs)
 {
-	if (fun->type != ValueType::NativeFunction && fun->type != ValueType::Function)
+	if (fun->type() != ValueType::NativeFunction && fun->type() != ValueType::Function)
 	{
 		throw 7;
 	}
-	else if (fun->type == ValueType::NativeFunction)
+	else if (fun->type() == ValueType::NativeFunction)
 	{
 		//call it
-		(*fun->func)(this,args,numargs);
+		(*fun->func())(this,args,numargs);
 		return this->stack.Pop();//Value(0);
 	}
-	unsigned int iptr = fun->_function->prototype->ptr;
+	unsigned int iptr = fun->_function()->prototype->ptr;
 
 	//push args onto stack
 	for (unsigned int i = 0; i < numargs; i++)
@@ -1619,7 +2648,7 @@ Value JetContext::Call(Value* fun, Value* args, unsigned int numargs)
 		this->stack.Push(args[i]);
 	}
 
-	auto func = fun->_function;
+	auto func = fun->_function();
 	if (numargs <= func->prototype->args)
 	{
 		for (int i = func->prototype->args-1; i >= 0; i--)
@@ -1632,9 +2661,8 @@ Value JetContext::Call(Value* fun, Value* args, unsigned int numargs)
 	}
 	else if (func->prototype->vararg)
 	{
-		sptr[func->prototype->locals-1] = this->NewArray();
-		auto arr = sptr[func->prototype->locals-1]._array->ptr;
-		arr->resize(numargs - func->prototype->args);
+		sptr[func->prototype->locals-1] = Value(this->gc.NewArray(numargs - func->prototype->args));
+		auto arr = sptr[func->prototype->locals-1]._array()->ptr;
 		for (int i = numargs-1; i >= 0; i--)
 		{
 			if (i < func->prototype->args)
@@ -1642,6 +2670,9 @@ Value JetContext::Call(Value* fun, Value* args, unsigned int numargs)
 			else
 				(*arr)[i] = stack.Pop();
 		}
+
+		//write barrier
+		gc.Remember(sptr[func->prototype->locals-1]);
 	}
 	else
 	{
@@ -1654,7 +2685,7 @@ Value JetContext::Call(Value* fun, Value* args, unsigned int numargs)
 		}
 	}
 
-	this->curframe = fun->_function;
+	this->curframe = fun->_function();
 
 	Value temp = this->Execute(iptr);
 	if (callstack.size() > 0)
@@ -1674,18 +2705,18 @@ Value JetContext::Call(const char* function, Value* args, unsigned int numargs)
 	}
 
 	Value fun = vars[variables[function]];
-	if (fun.type != ValueType::NativeFunction && fun.type != ValueType::Function)
+	if (fun.type() != ValueType::NativeFunction && fun.type() != ValueType::Function)
 	{
 		printf("ERROR: Variable '%s' is not a function\n", function);
 		return Value(0);
 	}
-	else if (fun.type == ValueType::NativeFunction)
+	else if (fun.type() == ValueType::NativeFunction)
 	{
 		//call it
-		(*fun.func)(this,args,numargs);
+		(*fun.func())(this,args,numargs);
 		return Value(0);
 	}
-	iptr = fun._function->prototype->ptr;
+	iptr = fun._function()->prototype->ptr;
 
 	//push args onto stack
 	for (unsigned int i = 0; i < numargs; i++)
@@ -1693,7 +2724,7 @@ Value JetContext::Call(const char* function, Value* args, unsigned int numargs)
 		this->stack.Push(args[i]);
 	}
 
-	auto func = fun._function;
+	auto func = fun._function();
 	if (numargs <= func->prototype->args)
 	{
 		for (int i = func->prototype->args-1; i >= 0; i--)
@@ -1706,9 +2737,8 @@ Value JetContext::Call(const char* function, Value* args, unsigned int numargs)
 	}
 	else if (func->prototype->vararg)
 	{
-		sptr[func->prototype->locals-1] = this->NewArray();
-		auto arr = sptr[func->prototype->locals-1]._array->ptr;
-		arr->resize(numargs - func->prototype->args);
+		sptr[func->prototype->locals-1] = Value(this->gc.NewArray(numargs - func->prototype->args));
+		auto arr = sptr[func->prototype->locals-1]._array()->ptr;
 		for (int i = numargs-1; i >= 0; i--)
 		{
 			if (i < func->prototype->args)
@@ -1716,6 +2746,9 @@ Value JetContext::Call(const char* function, Value* args, unsigned int numargs)
 			else
 				(*arr)[i] = stack.Pop();
 		}
+
+		//write barrier
+		gc.Remember(sptr[func->prototype->locals-1]);
 	}
 	else
 	{
@@ -29,11 +29,21 @@
 //#define JET_TIME_EXECUTION
 #endif
 
-#define GC_INTERVAL 100//number of allocations before running the GC
-#define GC_STEPS 4//number of incremental runs before a full
-
 #define JET_STACK_SIZE 800
 #define JET_MAX_CALLDEPTH 400
+
+#define JET_PROPERTY_CACHE_SIZE 4//number of shapes each property access remembers
+
+//define to count how often each pair of instructions executes back to back
+//used to pick which sequences are worth fusing into superinstructions
+//#define JET_PROFILE_OPCODES
+
+//use direct threaded dispatch (computed goto) on compilers that support it
+//define JET_NO_THREADED_DISPATCH to force the portable switch loop
+//the opcode profiler needs the switch loop
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(JET_NO_THREADED_DISPATCH) && !defined(JET_PROFILE_OPCODES)
+#define JET_THREADED_DISPATCH
+#endif
 //use the JetArray
 namespace Jet
 {
@@ -43,6 +53,27 @@ namespace Jet
 #define JetBind2(context, fun) 	auto temp__bind_##fun = [](Jet::JetContext* context,Jet::Value* args, int numargs) { context->Return(fun(args[0],args[1]));};context[#fun] = Jet::Value(temp__bind_##fun);
 #define JetBind2(context, fun, type) 	auto temp__bind_##fun = [](Jet::JetContext* context,Jet::Value* args, int numargs) { context->Return(fun((type)args[0],(type)args[1]));};context[#fun] = Jet::Value(temp__bind_##fun);
 
+	//inline cache for an instruction that accesses an object property by name
+	//remembers which slot the property was in for the last few shapes it saw
+	struct PropertyCache
+	{
+		struct Entry
+		{
+			Shape* shape;//shape of the object
+			Shape* prototype;//shape of the prototype if the property was found there, else 0
+			Shape* transition;//for stores that added the property, the shape after adding it
+			Shape* table;//for invokes on objects, the shape of the object table if the method was found there, else 0
+			unsigned int slot;
+		};
+		Entry entries[JET_PROPERTY_CACHE_SIZE];
+		unsigned int next;//entry to replace on the next miss
+
+		PropertyCache()
+		{
+			memset(this, 0, sizeof(PropertyCache));
+		}
+	};
+
 	struct Instruction
 	{
 		InstructionType instruction;
@@ -50,10 +81,17 @@ namespace Jet
 		{
 			int value;
 			Function* func;
+			struct
+			{
+				unsigned short a, b, c;//register operands
+			};
 		};
 		union
 		{
 			double value2;
+			long long integer;
+			PropertyCache* cache;//for LoadAt and StoreAt with a string, and Invoke
+			Shape* shape;//for NewObject, the shape of the last object it made
 			//const char* string;
 		};
 		const char* string;
@@ -89,9 +127,17 @@ namespace Jet
 
 		//actual data being worked on
 		std::vector<Instruction> ins;
+#ifdef JET_THREADED_DISPATCH
+		std::vector<const void*> threadedcode;//handler address for each instruction in ins
+#endif
 		std::vector<Value> vars;//where they are actually stored
+#ifdef JET_PROFILE_OPCODES
+		std::vector<unsigned long long> opcodepairs;//execution counts indexed by previous*count+current
+#endif
 
 		int labelposition;//used for keeping track in assembler
+		Shape* rootshape;//the empty shape all objects start with, owns every other shape
+		std::unordered_multimap<size_t, _JetInternedString*> interned;//by hash
 		CompilerContext compiler;//root compiler context
 
 		//core library prototypes
@@ -121,12 +167,21 @@ namespace Jet
 		Value NewObject();
 		Value NewArray();
 		Value NewUserdata(void* data, const Value& proto);
+		//makes a garbage collected copy of the string, without copy the string is deleted[] afterwards
 		Value NewString(char* string, bool copy = true);
 
+		//returns the interned copy of the string, adding it if this is the first time it was seen
+		//interned strings live as long as the context
+		Value Intern(const char* string);
+
 		//a helper function for registering metatables, returns an object
-		//this doesnt get garbage collected and you must delete it yourself after done using it
+		//this doesnt get garbage collected, call Release on it yourself after done using it
 		Value NewPrototype(const char* Typename);
 
+		//write barrier for the host, call it on an object, array or prototype after storing into it through Value::operator[]
+		//the collector cant see those stores, without this what was stored in an old object can be freed by the next minor collection
+		void Remember(const Value& container);
+
 		JetContext();
 		~JetContext();
 
@@ -143,6 +198,7 @@ namespace Jet
 		std::vector<IntermediateInstruction> Compile(const char* code, const char* filename = "file");
 
 		//xecutes global code and parses in ASM
+		//code that fails to assemble or verify is thrown away, leaving the context as it was
 		Value Assemble(const std::vector<IntermediateInstruction>& code);
 
 		//executes a function in the VM context
@@ -151,16 +207,67 @@ namespace Jet
 
 		void RunGC();//runs an iteration of the garbage collector
 
+		//does at most budget microseconds of garbage collection, returns true if that finished a collection
+		//the host can call this with whatever time it has left over, like at the end of a frame
+		bool GCStep(unsigned int budget);
+
+		//changes when the garbage collector runs as the script allocates, see GCPacing
+		//a pause makes those collections incremental, in steps of at most that many microseconds
+		void SetGCPacing(const GCPacing& pacing);
+		const GCPacing& GetGCPacing() const
+		{
+			return this->gc.pacing;
+		}
+
+		//how many threads mark during major collections of big heaps, 1 keeps it all on the calling thread
+		void SetGCThreads(unsigned int threads);
+
+		//frees what major collections found dead on a thread of its own instead of as the script allocates
+		void SetGCBackgroundSweep(bool background);
+
+		//when enabled, operations that only involve locals compile to register instructions
+		//rather than going through the stack, affects code compiled after it is set
+		void UseRegisterInstructions(bool use);
+
+		//when enabled, common instruction sequences are fused into single instructions
+		//affects code compiled after it is set
+		void UseSuperinstructions(bool use);
+
 		void Return(Value val);//returns value from native functions
 
+#ifdef JET_PROFILE_OPCODES
+		//prints the most frequently executed instruction pairs
+		void PrintOpcodeProfile(unsigned int count = 20);
+#endif
+
 	private:
 		int fptr;//frame pointer, not really used except in gc
 		Value* sptr;//stack pointer
 		Closure* curframe;
 		Value localstack[JET_STACK_SIZE];
+		Upvalue* openupvals;//captured locals still on the stack
 
 		//begin executing instructions at iptr index
 		Value Execute(int iptr);
+		//moves a call's arguments off the operand stack into the callee's locals
+		void PopArguments(Function* func, unsigned int args);
+
+		//checks every path through the function's code, which ends before end, and sets how much operand stack it needs
+		//throws a CompilerException if the code could pop more than it pushed, leave the function or reach a point with different depths
+		void Verify(Function* func, unsigned int end);
+
+		//returns the open upvalue for the local, adding one if no closure has captured it yet
+		Upvalue* FindUpvalue(Value* local);
+		//closes the open upvalues for locals at or above level on the stack
+		void Close(Value* level);
+
+		Value GetMember(const Value& loc, const Value& key);
+		Value* GetCachedMember(_JetObject* obj, const Value& key, PropertyCache* cache);
+		void SetCachedMember(_JetObject* obj, const Value& key, const Value& value, PropertyCache* cache);
+		Value GetCachedMethod(const Value& self, const Value& key, PropertyCache* cache);
+
+		//calls a native method of a userdata being looped over, leaving its result on the stack
+		void CallIterator(const Value& iter, const char* method, int iptr);
 
 		//debug functions
 		void GetCode(int ptr, std::string& ret, unsigned int& line);
@@ -30,12 +30,19 @@ namespace Jet
 		"Dup",
 		"Pop",
 		"LdNum",
+		"LdInt",
 		"LdNull",
 		"LdStr",
 		"LoadFunction",
 		"Jump",
 		"JumpTrue",
 		"JumpFalse",
+		"JumpIfNotLt",
+		"JumpIfNotGt",
+		"JumpIfNotLtE",
+		"JumpIfNotGtE",
+		"JumpIfNotEq",
+		"JumpIfEq",
 		"NewArray",
 		"NewObject",
 
@@ -53,13 +60,37 @@ namespace Jet
 		"LoadAt",
 		"StoreAt",
 
+		//for each loops
+		"IterPrep",
+		"IterNext",
+		"IterKey",
+		"ForRangePrep",
+		"ForRangeLoop",
+
 		//these all work on the last value in the stack
 		"ECall",
+		"TailCall",
+		"Invoke",
+		"TailInvoke",
 
 		"Call",
 		"Return",
 		"Close",
 
+		//register instructions, operands are local indices
+		"RAdd",
+		"RSub",
+		"RMul",
+		"RDiv",
+		"RModulus",
+		"RMove",
+
+		//superinstructions, fused from common sequences
+		"LAddInt",
+		"LSubInt",
+		"LIncr",
+		"LDecr",
+
 		//dummy instructions for the assembler/debugging
 		"Label",
 		"Comment",
@@ -97,6 +128,7 @@ namespace Jet
 		Pop,
 
 		LdNum,
+		LdInt,
 		LdNull,
 		LdStr,
 		LoadFunction,
@@ -105,6 +137,15 @@ namespace Jet
 		JumpTrue,
 		JumpFalse,
 
+		//compare the top two values and jump to the label unless the comparison holds
+		//conditions of ifs and loops compile to these instead of a compare and a JumpFalse
+		JumpIfNotLt,
+		JumpIfNotGt,
+		JumpIfNotLtE,
+		JumpIfNotGtE,
+		JumpIfNotEq,
+		JumpIfEq,//unless NotEq holds
+
 		NewArray,
 		NewObject,
 
@@ -114,21 +155,48 @@ namespace Jet
 		LStore,
 		LLoad,
 		//captured vars
-		CStore,
-		CLoad,
-		CInit, //to setup captures
+		CStore,//upvalue index
+		CLoad,//upvalue index
+		CInit, //describes an upvalue of the function before it, only the assembler sees these
 
 		//index functions
 		LoadAt,
 		StoreAt,
 
+		//for each loops, the container and the position in it are kept in two locals
+		IterPrep,//a, pops the container into local a and starts the position in a+1
+		IterNext,//label a, pushes the next element or jumps to label once there are none left
+		IterKey,//a, pushes the key of the element IterNext just pushed
+
+		//counting loops, the loop variable is local a, the counter and the limit are a+1 and a+2
+		ForRangePrep,//label a, pops the start and end, jumps to label if there is nothing to count
+		ForRangeLoop,//label a, steps the counter and jumps back to label while it is below the limit
+
 		//these all work on the last value in the stack
 		ECall,
+		TailCall,//an ECall whose result is returned right away, script functions reuse the caller's frame
+		Invoke,//name n, calls the method of the value on top of the stack, that value is the last of the n arguments
+		TailInvoke,//an Invoke whose result is returned right away
 
 		Call,
 		Return,
 
-		Close, //closes all opened closures in a function
+		Close, //closes upvalues of locals at or above a point of the stack
+
+		//register instructions, these work directly on locals
+		//a is the destination, b and c are the sources
+		RAdd,
+		RSub,
+		RMul,
+		RDiv,
+		RModulus,
+		RMove,
+
+		//superinstructions, each replaces a common sequence of the above
+		LAddInt,//LLoad a, LdInt k, Add, LStore a
+		LSubInt,//LLoad a, LdInt k, Sub, LStore a
+		LIncr,//LLoad a, Incr, LStore a
+		LDecr,//LLoad a, Decr, LStore a
 
 		//dummy instructions for the assembler/debugging
 		Label,
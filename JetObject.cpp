@@ -0,0 +1,211 @@
+#include "JetObject.h"
+
+using namespace Jet;
+
+_JetObjectIndex::_JetObjectIndex()
+{
+	this->groups = 1;
+	this->count = 0;
+	this->control = new unsigned char[GroupSize];
+	this->slots = new unsigned int[GroupSize];
+	memset(this->control, Empty, GroupSize);
+}
+
+_JetObjectIndex::~_JetObjectIndex()
+{
+	delete[] this->control;
+	delete[] this->slots;
+}
+
+void _JetObjectIndex::Add(const Value* keys)
+{
+	//keep the load under 7/8 so probes stay short
+	if ((this->count+1)*8 > this->groups*GroupSize*7)
+	{
+		delete[] this->control;
+		delete[] this->slots;
+		this->groups *= 2;
+		this->control = new unsigned char[this->groups*GroupSize];
+		this->slots = new unsigned int[this->groups*GroupSize];
+		memset(this->control, Empty, this->groups*GroupSize);
+		for (unsigned int i = 0; i < this->count; i++)
+			this->Insert(HashFunction()(keys[i]), i);
+	}
+	this->Insert(HashFunction()(keys[this->count]), this->count);
+	this->count++;
+}
+
+void _JetObjectIndex::Insert(size_t hash, unsigned int slot)
+{
+	unsigned int mask = this->groups-1;
+	unsigned int group = (unsigned int)(hash >> 7) & mask;
+	for (unsigned int probe = 1; ; probe++)
+	{
+		unsigned char* ctrl = &this->control[group*GroupSize];
+		for (unsigned int i = 0; i < GroupSize; i++)
+		{
+			if (ctrl[i] == Empty)
+			{
+				ctrl[i] = hash & 0x7F;
+				this->slots[group*GroupSize+i] = slot;
+				return;
+			}
+		}
+		group = (group + probe) & mask;
+	}
+}
+
+Shape::Shape(Shape* parent)
+{
+	this->parent = parent;
+	this->index = 0;
+}
+
+Shape::~Shape()
+{
+	for (auto ii: this->transitions)
+		delete ii.second;
+	delete this->index;
+}
+
+Shape* Shape::AddKey(const Value& key)
+{
+	for (auto ii: this->transitions)
+	{
+		if (ii.first == key)
+			return ii.second;
+	}
+
+	if (this->keys.size() >= JET_SHAPE_MAX_SLOTS || this->transitions.size() >= JET_SHAPE_MAX_TRANSITIONS)
+		return 0;
+
+	//the collector doesnt look at shapes, so a collected string key has to stay around as long as they do
+	if (key.collected())
+		_JetGCString::Get(key._string())->pinned = true;
+
+	Shape* shape = new Shape(this);
+	shape->keys = this->keys;
+	shape->keys.push_back(key);
+	if (shape->keys.size() > JET_SHAPE_LINEAR_SEARCH)
+	{
+		shape->index = new _JetObjectIndex;
+		for (unsigned int i = 0; i < shape->keys.size(); i++)
+			shape->index->Add(shape->keys.data());
+	}
+	this->transitions.push_back(std::pair<Value, Shape*>(key, shape));
+	return shape;
+}
+
+_JetObjectBacking::_JetObjectBacking(Shape* root)
+{
+	this->shape = root;
+	this->values = 0;
+	this->keys = 0;
+	this->index = 0;
+	this->count = this->capacity = 0;
+	this->array = 0;
+	this->arraysize = this->arraycapacity = 0;
+}
+
+_JetObjectBacking::~_JetObjectBacking()
+{
+	delete[] this->values;
+	delete[] this->keys;
+	delete this->index;
+	delete[] this->array;
+}
+
+Value& _JetObjectBacking::operator[](const Value& key)
+{
+	unsigned int a;
+	if (key.type() != ValueType::String && ArrayIndex(key, a))
+	{
+		if (a < this->arraysize)
+			return this->array[a];
+
+		//the next key after the array part extends it, unless it was already added to the slots
+		if (a == this->arraysize && this->IndexOf(key) < 0)
+		{
+			if (this->arraysize == this->arraycapacity)
+			{
+				this->arraycapacity = this->arraycapacity ? this->arraycapacity*2 : 4;
+				Value* array = new Value[this->arraycapacity];
+				for (unsigned int i = 0; i < this->arraysize; i++)
+					array[i] = this->array[i];
+				delete[] this->array;
+				this->array = array;
+			}
+			this->array[this->arraysize] = Value();
+			return this->array[this->arraysize++];
+		}
+	}
+
+	int i = this->IndexOf(key);
+	if (i >= 0)
+		return this->values[i];
+
+	if (this->shape)
+	{
+		Shape* next = key.type() == ValueType::String ? this->shape->AddKey(key) : 0;
+		if (next)
+		{
+			this->AddSlot(next, Value());
+			return this->values[this->count-1];
+		}
+		this->ToDictionary();
+	}
+
+	if (this->count == this->capacity)
+		this->Grow(this->capacity ? this->capacity*2 : 4);
+	this->keys[this->count] = key;
+	this->values[this->count] = Value();
+	this->index->Add(this->keys);
+	return this->values[this->count++];
+}
+
+void _JetObjectBacking::SetShape(Shape* shape)
+{
+	if (this->count)
+		throw RuntimeException("Cannot set the shape of an object that already has keys!");
+
+	if (shape->keys.size() > this->capacity)
+		this->Grow(shape->keys.size());
+	for (unsigned int i = 0; i < shape->keys.size(); i++)
+		this->values[i] = Value();
+	this->count = shape->keys.size();
+	this->shape = shape;
+}
+
+void _JetObjectBacking::ToDictionary()
+{
+	if (this->shape == 0)
+		return;
+
+	this->keys = new Value[this->capacity];
+	this->index = new _JetObjectIndex;
+	for (unsigned int i = 0; i < this->count; i++)
+	{
+		this->keys[i] = this->shape->keys[i];
+		this->index->Add(this->keys);
+	}
+	this->shape = 0;
+}
+
+void _JetObjectBacking::Grow(unsigned int capacity)
+{
+	Value* values = new Value[capacity];
+	for (unsigned int i = 0; i < this->count; i++)
+		values[i] = this->values[i];
+	delete[] this->values;
+	this->values = values;
+
+	if (this->shape == 0)
+	{
+		Value* keys = new Value[capacity];
+		for (unsigned int i = 0; i < this->count; i++)
+			keys[i] = this->keys[i];
+		delete[] this->keys;
+		this->keys = keys;
+	}
+	this->capacity = capacity;
+}
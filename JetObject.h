@@ -0,0 +1,348 @@
+#ifndef _JET_OBJECT_HEADER
+#define _JET_OBJECT_HEADER
+
+#include "Value.h"
+
+#define JET_SHAPE_MAX_SLOTS 64//objects with more keys than this switch to dictionary mode
+#define JET_SHAPE_MAX_TRANSITIONS 128//shapes with more children than this dont get any more
+#define JET_SHAPE_LINEAR_SEARCH 8//shapes with more keys than this get a hash index
+#define JET_OBJECT_MAX_ARRAY 0x7FFFFFFF//integer keys past this always go in the hash part
+
+//probe hash index groups with sse2 where it is available
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JET_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Jet
+{
+	//open addressing hash index from keys to their slot, in the style of a swiss table
+	//the keys themselves live in an array owned by whoever uses the index, slot i holds keys[i]
+	//each slot has a control byte holding 7 bits of the key's hash, or empty
+	//lookups check a whole group of 16 control bytes at once and only compare keys whose byte matches
+	//keys are only ever added, so there are no tombstones and an empty byte ends a probe
+	class _JetObjectIndex
+	{
+		static const unsigned char Empty = 0x80;
+		static const unsigned int GroupSize = 16;
+
+		unsigned char* control;
+		unsigned int* slots;
+		unsigned int groups;//power of two
+		unsigned int count;
+
+	public:
+		_JetObjectIndex();
+		~_JetObjectIndex();
+
+		//returns the slot of the key or -1
+		int Find(const Value& key, const Value* keys) const
+		{
+			size_t hash = HashFunction()(key);
+			unsigned char tag = hash & 0x7F;
+			unsigned int mask = this->groups-1;
+			unsigned int group = (unsigned int)(hash >> 7) & mask;
+			for (unsigned int probe = 1; ; probe++)
+			{
+				const unsigned char* ctrl = &this->control[group*GroupSize];
+#ifdef JET_SSE2
+				__m128i bytes = _mm_loadu_si128((const __m128i*)ctrl);
+				unsigned int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)tag)));
+				while (matches)
+				{
+					unsigned int i = group*GroupSize + JetCountTrailingZeros(matches);
+					if (keys[this->slots[i]] == key)
+						return this->slots[i];
+					matches &= matches-1;
+				}
+				//empty bytes are the only ones with the high bit set
+				if (_mm_movemask_epi8(bytes))
+					return -1;
+#else
+				bool empty = false;
+				for (unsigned int i = 0; i < GroupSize; i++)
+				{
+					if (ctrl[i] == tag && keys[this->slots[group*GroupSize+i]] == key)
+						return this->slots[group*GroupSize+i];
+					empty |= ctrl[i] == Empty;
+				}
+				if (empty)
+					return -1;
+#endif
+				//triangular probing visits every group when the count is a power of two
+				group = (group + probe) & mask;
+			}
+		}
+
+		//indexes the next key, keys[size()]
+		void Add(const Value* keys);
+
+		unsigned int size() const
+		{
+			return this->count;
+		}
+
+	private:
+		void Insert(size_t hash, unsigned int slot);
+
+		static unsigned int JetCountTrailingZeros(unsigned int x)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_ctz(x);
+#else
+			unsigned int n = 0;
+			while ((x & 1) == 0)
+			{
+				x >>= 1;
+				n++;
+			}
+			return n;
+#endif
+		}
+	};
+
+	//a hidden class, it says which keys an object has and which slot each one is in
+	//objects that were given the same keys in the same order share a shape
+	//shapes form a tree under an empty root shape owned by the context and live as long as it does
+	struct Shape
+	{
+		Shape* parent;
+		std::vector<Value> keys;//in slot order, always strings
+		std::vector<std::pair<Value, Shape*>> transitions;//shapes with one more key than this one
+		_JetObjectIndex* index;//key to slot, only for large shapes
+
+		Shape(Shape* parent = 0);
+		~Shape();
+
+		//returns the slot of the key or -1
+		int Find(const Value& key) const
+		{
+			if (this->index)
+				return this->index->Find(key, this->keys.data());
+
+			for (unsigned int i = 0; i < this->keys.size(); i++)
+			{
+				if (this->keys[i] == key)
+					return i;
+			}
+			return -1;
+		}
+
+		//returns the shape that has the key added after this one's keys
+		//or 0 if objects with this shape should not get any more keys
+		Shape* AddKey(const Value& key);
+	};
+
+	//what iterating over an object gives you
+	struct _JetObjectEntry
+	{
+		Value first;//a copy, keys in the array part are made up as you go
+		Value& second;
+	};
+
+	//the storage of a script object
+	//normally keys live in the shape and the object is just a flat array of values
+	//objects with non string keys, too many keys or that are indexed like maps switch to dictionary mode
+	//where they own their keys and a hash index of them
+	//like in lua, the integer keys 0 to n-1 are kept apart in a plain array and never hashed
+	//this works in either mode, a key is only ever in the array part or the slots, never both
+	//the slot functions below (IndexOf, GetKey, GetSlot...) only deal with the slots
+	class _JetObjectBacking
+	{
+		Shape* shape;//0 in dictionary mode
+		Value* values;
+		Value* keys;//only in dictionary mode
+		_JetObjectIndex* index;//only in dictionary mode
+		unsigned int count, capacity;
+
+		Value* array;//values for the keys 0 to arraysize-1
+		unsigned int arraysize, arraycapacity;
+
+	public:
+		class iterator
+		{
+			_JetObjectBacking* backing;
+			unsigned int i;
+		public:
+			iterator() : backing(0), i(0) { }
+			iterator(_JetObjectBacking* backing, unsigned int i) : backing(backing), i(i) { }
+
+			//goes through the array part first, then the slots
+			_JetObjectEntry operator*() const
+			{
+				if (i < backing->arraysize)
+				{
+					_JetObjectEntry e = { Value((int)i), backing->array[i] };
+					return e;
+				}
+				_JetObjectEntry e = { backing->GetKey(i - backing->arraysize), backing->values[i - backing->arraysize] };
+				return e;
+			}
+
+			iterator& operator++()
+			{
+				i++;
+				return *this;
+			}
+
+			bool operator==(const iterator& other) const
+			{
+				return this->i == other.i && this->backing == other.backing;
+			}
+
+			bool operator!=(const iterator& other) const
+			{
+				return this->i != other.i || this->backing != other.backing;
+			}
+		};
+
+		_JetObjectBacking(Shape* root);
+		~_JetObjectBacking();
+
+		//returns the value for the key, adding it as null if it isnt there
+		Value& operator[](const Value& key);
+
+		//returns the slot of the key or -1
+		int IndexOf(const Value& key) const
+		{
+			if (this->shape)
+				return key.type() == ValueType::String ? this->shape->Find(key) : -1;
+
+			return this->index->Find(key, this->keys);
+		}
+
+		//returns a pointer to the value for the key or 0 if it isnt there
+		//the pointer is only good until the next key is added
+		Value* Find(const Value& key)
+		{
+			unsigned int a;
+			if (key.type() != ValueType::String && ArrayIndex(key, a) && a < this->arraysize)
+				return &this->array[a];
+
+			int i = this->IndexOf(key);
+			return i < 0 ? 0 : &this->values[i];
+		}
+
+		//the number of keys, in both parts
+		unsigned int size() const
+		{
+			return this->arraysize + this->count;
+		}
+
+		//sets i to the key if it is a whole number that can go in the array part
+		static bool ArrayIndex(const Value& key, unsigned int& i)
+		{
+			if (key.IsInteger())
+			{
+				if (key.integer() < 0 || key.integer() >= JET_OBJECT_MAX_ARRAY)
+					return false;
+				i = (unsigned int)key.integer();
+				return true;
+			}
+			else if (key.IsNumber())
+			{
+				//numbers holding a whole number are the same key as that integer
+				if (!(key.value() >= 0 && key.value() < JET_OBJECT_MAX_ARRAY) || (double)(unsigned int)key.value() != key.value())
+					return false;
+				i = (unsigned int)key.value();
+				return true;
+			}
+			return false;
+		}
+
+		Shape* GetShape() const
+		{
+			return this->shape;
+		}
+
+		const Value& GetKey(unsigned int i) const
+		{
+			return this->shape ? this->shape->keys[i] : this->keys[i];
+		}
+
+		Value& GetSlot(unsigned int i)
+		{
+			return this->values[i];
+		}
+
+		//adds the value for the key that the shape next adds to the current shape
+		void AddSlot(Shape* next, const Value& value)
+		{
+			if (this->count == this->capacity)
+				this->Grow(this->capacity ? this->capacity*2 : 4);
+			this->values[this->count++] = value;
+			this->shape = next;
+		}
+
+		//sets an empty object to the given shape with all of its values null
+		void SetShape(Shape* shape);
+
+		//moves the keys into the object, used once it is treated like a map
+		void ToDictionary();
+
+		iterator begin()
+		{
+			return iterator(this, 0);
+		}
+
+		iterator end()
+		{
+			return iterator(this, this->arraysize + this->count);
+		}
+
+	private:
+		void Grow(unsigned int capacity);
+	};
+
+	typedef _JetObjectBacking::iterator _JetObjectIterator;
+
+	//these need the object backing to be complete
+	inline Value& Value::operator[] (int key)
+	{
+		switch (type())
+		{
+		case ValueType::Array:
+			{
+				return (*this->_array()->ptr)[key];
+			}
+		case ValueType::Object:
+			{
+				return (*this->_object()->ptr)[key];
+			}
+		default:
+			throw RuntimeException("Cannot index type " + (std::string)ValueTypes[(int)this->type()]);
+		}
+	}
+
+	inline Value& Value::operator[] (const char* key)
+	{
+		switch (type())
+		{
+		case ValueType::Object:
+			{
+				return (*this->_object()->ptr)[key];
+			}
+		default:
+			throw RuntimeException("Cannot index type " + (std::string)ValueTypes[(int)this->type()]);
+		}
+	}
+
+	inline Value& Value::operator[] (const Value& key)
+	{
+		switch (type())
+		{
+		case ValueType::Array:
+			{
+				return (*this->_array()->ptr)[(int)key.GetInteger()];
+			}
+		case ValueType::Object:
+			{
+				return (*this->_object()->ptr)[key];
+			}
+		default:
+			throw RuntimeException("Cannot index type " + (std::string)ValueTypes[(int)this->type()]);
+		}
+	}
+}
+
+#endif
@@ -94,6 +94,7 @@ void Lexer::Init()
 	operators["\""] = TokenType::String;
 
 	operators["..."] = TokenType::Ellipses;
+	operators[".."] = TokenType::Range;
 
 	//comments
 	operators["//"] = TokenType::LineComment;
@@ -283,6 +284,10 @@ Token Lexer::Next()
 				if (!(c == '.' || IsNumber(c)))
 					break;
 
+				//the start of a range, not a decimal point
+				if (c == '.' && index+1 < text.length() && text[index+1] == '.')
+					break;
+
 				this->ConsumeChar();
 			}
 
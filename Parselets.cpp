@@ -97,18 +97,36 @@ Expression* ForParselet::parse(Parser* parser, Token token)
 	{
 		if (parser->LookAhead(1).type == TokenType::Name)
 		{
-			Token n = parser->LookAhead(2);
+			//for (local k, v in container) gets the keys too
+			bool pair = parser->LookAhead(2).type == TokenType::Comma && parser->LookAhead(3).type == TokenType::Name;
+			Token n = parser->LookAhead(pair ? 4 : 2);
 			if (n.type == TokenType::Name && n.text == "in")
 			{
 				//ok its a foreach loop
 				parser->Consume();
-				Token name = parser->Consume();
+				Token key, name = parser->Consume();
+				if (pair)
+				{
+					parser->Consume();
+					key = name;
+					name = parser->Consume();
+				}
 				parser->Consume();
-				Token container = parser->Consume();
+				auto container = parser->parseExpression();
+
+				//or counting from start up to end, for (local i in start..end)
+				if (pair == false && parser->MatchAndConsume(TokenType::Range))
+				{
+					auto end = parser->parseExpression();
+					parser->Consume(TokenType::RightParen);
+
+					auto block = new ScopeExpression(parser->parseBlock());
+					return new ForRangeExpression(name, container, end, block);
+				}
 				parser->Consume(TokenType::RightParen);
 
 				auto block = new ScopeExpression(parser->parseBlock());
-				return new ForEachExpression(name, container, block);
+				return new ForEachExpression(key, name, container, block);
 			}
 		}
 	}
@@ -30,7 +30,11 @@ namespace Jet
 	public:
 		Expression* parse(Parser* parser, Token token)
 		{
-			return new NumberExpression(::atof(token.getText().c_str()));
+			double value = ::atof(token.getText().c_str());
+
+			//literals without a decimal point are integers if they can be represented exactly
+			bool integer = token.getText().find('.') == std::string::npos && value <= 9007199254740992.0;
+			return new NumberExpression(value, integer);
 		}
 	};
 
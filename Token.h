@@ -68,6 +68,7 @@ namespace Jet
 		Semicolon,
 		Comma,
 		Ellipses,
+		Range,
 
 		Null,
 
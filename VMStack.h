@@ -4,6 +4,8 @@
 
 #include "JetExceptions.h"
 
+#define JET_VMSTACK_SIZE 5000//values each stack can hold
+
 namespace Jet
 {
 	template<class T>
@@ -12,7 +14,7 @@ namespace Jet
 		unsigned int _size;
 		
 	public:
-		T mem[5000];
+		T mem[JET_VMSTACK_SIZE];
 		VMStack()
 		{
 			_size = 0;
@@ -70,12 +72,35 @@ namespace Jet
 
 		void Push(T item)
 		{
-			if (_size >= 5000)
+			if (_size >= JET_VMSTACK_SIZE)
 				throw RuntimeException("Stack overflow");
 
 			mem[_size++] = item;
 		}
 
+		//these skip the bounds checks, for verified code that made sure there was room when its function was entered
+		void PushUnchecked(T item)
+		{
+			mem[_size++] = item;
+		}
+
+		//the popped value stays in place until the next push, so it can be used without copying it out
+		T& PopUnchecked()
+		{
+			return mem[--_size];
+		}
+
+		void QuickPopUnchecked(int times)
+		{
+			_size -= times;
+		}
+
+		//how many more values fit
+		unsigned int headroom()
+		{
+			return JET_VMSTACK_SIZE - _size;
+		}
+
 		unsigned int size()
 		{
 			return _size;
@@ -1,33 +1,250 @@
 #include "Value.h"
 
+#include <chrono>
+#include <cstring>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
 using namespace Jet;
 
-inline size_t stringhash(const char* p)
+//wyhash, fast and good enough that the seed keeps keys from being picked to collide
+//see github.com/wangyi-fudan/wyhash
+static const unsigned long long wyp[4] = { 0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL };
+
+//sets a and b to the low and high halves of a*b
+static inline void wymum(unsigned long long& a, unsigned long long& b)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128)a*b;
+	a = (unsigned long long)r;
+	b = (unsigned long long)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	a = _umul128(a, b, &b);
+#else
+	unsigned long long ha = a >> 32, hb = b >> 32, la = (unsigned int)a, lb = (unsigned int)b;
+	unsigned long long rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb, t = rl + (rm0 << 32);
+	unsigned long long c = t < rl;
+	unsigned long long lo = t + (rm1 << 32);
+	c += lo < t;
+	a = lo;
+	b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline unsigned long long wymix(unsigned long long a, unsigned long long b)
+{
+	wymum(a, b);
+	return a ^ b;
+}
+
+static inline unsigned long long wyr8(const unsigned char* p)
+{
+	unsigned long long v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline unsigned long long wyr4(const unsigned char* p)
+{
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline unsigned long long wyr3(const unsigned char* p, size_t k)
 {
-	size_t tot = *p;
-	while (*(p++))
+	return (((unsigned long long)p[0]) << 16) | (((unsigned long long)p[k >> 1]) << 8) | p[k - 1];
+}
+
+static unsigned long long wyhash(const void* key, size_t len, unsigned long long seed)
+{
+	const unsigned char* p = (const unsigned char*)key;
+	seed ^= wymix(seed ^ wyp[0], wyp[1]);
+	unsigned long long a, b;
+	if (len <= 16)
 	{
-		tot *= *p;
-		tot -= 3*(*p);
+		if (len >= 4)
+		{
+			a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+			b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+		}
+		else if (len > 0)
+		{
+			a = wyr3(p, len);
+			b = 0;
+		}
+		else
+			a = b = 0;
 	}
-	return tot;
+	else
+	{
+		size_t i = len;
+		if (i > 48)
+		{
+			unsigned long long see1 = seed, see2 = seed;
+			do
+			{
+				seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+				see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+				see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			}
+			while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16)
+		{
+			seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = wyr8(p + i - 16);
+		b = wyr8(p + i - 8);
+	}
+	a ^= wyp[1];
+	b ^= seed;
+	wymum(a, b);
+	return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+//picked once per process so hashes, and so which keys collide, cant be known ahead of time
+//define JET_HASH_SEED to a number to get the same hashes every run
+static unsigned long long JetHashSeed()
+{
+#ifdef JET_HASH_SEED
+	return JET_HASH_SEED;
+#else
+	static int local;
+	unsigned long long seed = (unsigned long long)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	return wymix(seed ^ wyp[2], (unsigned long long)(size_t)&local ^ wyp[3]);
+#endif
+}
+static const unsigned long long hashseed = JetHashSeed();
+
+//for values that are one word, the word is mixed with the seed
+static inline size_t hashword(unsigned long long word)
+{
+	return (size_t)wymix(word ^ hashseed ^ wyp[0], wyp[1]);
+}
+
+std::size_t HashFunction::Hash(const char* data, size_t length)
+{
+	return (size_t)wyhash(data, length, hashseed);
 }
 
 std::size_t HashFunction::operator ()(const Value &v) const
 {
-	switch(v.type)
+	switch(v.type())
 	{
 	case ValueType::Null:
-		return 0;
+		return hashword(0);
 	case ValueType::Array:
 	case ValueType::NativeFunction:
 	case ValueType::Object:
-		return (size_t)v._array;
+	case ValueType::Function:
+	case ValueType::Userdata:
+		return hashword((unsigned long long)(size_t)v._array());
+	case ValueType::Number:
+		{
+			//numbers holding an integer must hash the same as that integer
+			if (v.value() >= -9223372036854775808.0 && v.value() < 9223372036854775808.0 && (double)(long long)v.value() == v.value())
+				return hashword((unsigned long long)(long long)v.value());
+
+			//otherwise hash all the bits so fractions dont collide
+			return hashword(v.bits);
+		}
+	case ValueType::Integer:
+		return hashword((unsigned long long)v.integer());
+	case ValueType::String:
+		//interned and collected strings worked out the same hash when they were made
+		if (v.interned())
+			return _JetInternedString::Get(v._string())->hash;
+		else if (v.collected())
+			return _JetGCString::Get(v._string())->hash;
+		return Hash(v._string(), strlen(v._string()));
+	}
+	return 0;
+}
+
+std::string Value::ToString(int depth) const
+{
+	switch(this->type())
+	{
+	case ValueType::Null:
+		return "Null";
 	case ValueType::Number:
-		return v.value;
+		return std::to_string(this->value());
+	case ValueType::Integer:
+		return std::to_string(this->integer());
 	case ValueType::String:
-		return stringhash(v._string);
+		return this->_string();
 	case ValueType::Function:
-		return (size_t)v._function;
+		return "[Function "+this->_function()->prototype->name+"]";//"[Function "+::std::to_string(this->_function->prototype->ptr)+"]";//"[Function "+this->_function->prototype->name+"]";
+	case ValueType::NativeFunction:
+		return "[NativeFunction "+std::to_string((unsigned int)this->func())+"]";
+	case ValueType::Array:
+		{
+			std::string str = "[\n";
+
+			if (depth++ > 3)
+				return "[Array " + std::to_string((int)this->_array())+"]";
+
+			int i = 0;
+			for (auto ii: *this->_array()->ptr)
+			{
+				str += "\t";
+				str += std::to_string(i++);
+				str += " = ";
+				str += ii.ToString(depth) + "\n";
+			}
+			str += "]";
+			return str;
+		}
+	case ValueType::Object:
+		{
+			std::string str = "{\n";
+
+			if (depth++ > 3)
+				return "[Object " + std::to_string((int)this->_object())+"]";
+
+			for (auto ii: *this->_object()->ptr)
+			{
+				str += "\t";
+				str += ii.first.ToString(depth);
+				str += " = ";
+				str += ii.second.ToString(depth) + "\n";
+			}
+			str += "}";
+			return str;
+		}
+	case ValueType::Userdata:
+		{
+			return "[Userdata "+std::to_string((int)this->_userdata())+"]";
+		}
+	default:
+		return "";
+	}
+}
+
+Value Value::CallMetamethod(const char* name, const Value* self)
+{
+	JetContext* context;
+	auto iter = this->GetPrototype()->ptr->Find(name);
+	if (iter)
+	{
+		//context->Call(
+		//return iter->second.
 	}
-};
\ No newline at end of file
+}
+
+//only prototypes are ours to delete, everything else lives in a heap cell the collector frees
+void Value::Release()
+{
+	if (type() == ValueType::Object && this->_object()->unmanaged)
+	{
+		delete this->_object()->ptr;
+		delete this->_object();
+	}
+}
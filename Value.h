@@ -2,7 +2,6 @@
 #define _VALUE_HEADER
 
 #include "JetExceptions.h"
-//#include "Object.h"
 
 #include <map>
 #include <functional>
@@ -10,6 +9,10 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <cmath>
+#include <climits>
+#include <cstddef>
+#include <cstring>
 
 namespace Jet
 {
@@ -32,6 +35,63 @@ namespace Jet
 
 	struct Value;
 
+	//integer arithmetic helpers, these return false if the result would overflow
+	inline bool IntegerAdd(long long a, long long b, long long& result)
+	{
+		long long r = (long long)((unsigned long long)a + (unsigned long long)b);
+		if (((a ^ r) & (b ^ r)) < 0)
+			return false;
+		result = r;
+		return true;
+	}
+
+	inline bool IntegerSub(long long a, long long b, long long& result)
+	{
+		long long r = (long long)((unsigned long long)a - (unsigned long long)b);
+		if (((a ^ b) & (a ^ r)) < 0)
+			return false;
+		result = r;
+		return true;
+	}
+
+	inline bool IntegerMul(long long a, long long b, long long& result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return !__builtin_mul_overflow(a, b, &result);
+#else
+		if (a == 0 || b == 0)
+		{
+			result = 0;
+			return true;
+		}
+		if ((a == -1 && b == LLONG_MIN) || (b == -1 && a == LLONG_MIN))
+			return false;
+		long long r = (long long)((unsigned long long)a * (unsigned long long)b);
+		if (r / b != a)
+			return false;
+		result = r;
+		return true;
+#endif
+	}
+
+	inline long long IntegerShift(long long a, long long b)
+	{
+		//positive shifts left, negative shifts right, anything over the width saturates
+		if (b >= 64)
+			return 0;
+		else if (b <= -64)
+			return a < 0 ? -1 : 0;
+		else if (b >= 0)
+			return (long long)((unsigned long long)a << b);
+		return a >> -b;
+	}
+
+	//returns true if the double holds exactly the integer i
+	inline bool IntegerEqualsNumber(long long i, double d)
+	{
+		return d >= -9223372036854775808.0 && d < 9223372036854775808.0 && (double)(long long)d == d && (long long)d == i;
+	}
+
 
 	enum class ValueType
 	{
@@ -39,6 +99,7 @@ namespace Jet
 		//this is used for the GC being able to tell what it is quickly
 		Null = 0,
 		Number,
+		Integer,//a Number stored as a 48 bit integer
 		NativeFunction,
 		String,//add more
 		Object,//todo
@@ -46,13 +107,18 @@ namespace Jet
 		Function,
 		//Closure,//an allocated one
 		Userdata,//kinda todo
+		Capture,//a captured variable, only the collector sees these
 	};
 
-	static const char* ValueTypes[] = { "Null", "Number", "NativeFunction", "String" , "Object", "Array", "Function", "Userdata"};
+	static const char* ValueTypes[] = { "Null", "Number", "Integer", "NativeFunction", "String" , "Object", "Array", "Function", "Userdata", "Capture"};
 
+	//hashes values for use as keys, seeded so the hashes are different every run
 	class HashFunction {
 	public:
 		std::size_t operator ()(const Value &v) const;
+
+		//hashes the characters the same way as a string value holding them
+		static std::size_t Hash(const char* data, size_t length);
 	};
 
 	struct String
@@ -61,11 +127,63 @@ namespace Jet
 		char* data;
 	};
 
-	typedef std::unordered_map<Value, Value, HashFunction> _JetObjectBacking;
+	//a string interned by a context, there is only one of these for each string of characters
+	//the hash and length are worked out once, the characters follow them in the same allocation
+	//values point straight at the characters so they still work as normal c strings
+	struct _JetInternedString
+	{
+		size_t hash;
+		unsigned int length;
+		char data[1];//really length+1 long
+
+		//gets the header back from the characters of an interned string
+		static _JetInternedString* Get(const char* data)
+		{
+			return (_JetInternedString*)(data - offsetof(_JetInternedString, data));
+		}
+	};
+
+	//a string made while running, it lives in the collector's heap and is freed once nothing references it
+	//laid out like an interned string, behind the mark flags every heap object starts with
+	struct _JetGCString
+	{
+		bool mark;
+		bool grey;
+		bool pinned;//used as a key in a shape, those live as long as the context so it has to as well
+		unsigned int length;
+		size_t hash;
+		char data[1];//really length+1 long
+
+		//gets the header back from the characters of a collected string
+		static _JetGCString* Get(const char* data)
+		{
+			return (_JetGCString*)(data - offsetof(_JetGCString, data));
+		}
+	};
+
+	class _JetObjectBacking;//in JetObject.h, needs Value to be complete
+	struct Shape;
 	//typedef GCVal<std::map<std::string, Value>*> _JetObject; 
-	typedef GCVal<_JetObjectBacking*> _JetObject; 
+
+	//the prototype lives with the object rather than in every Value pointing at it
+	struct _JetObject: public GCVal<_JetObjectBacking*>
+	{
+		_JetObject* prototype;
+		bool unmanaged;//made by NewPrototype, it isnt in the collector's heap and the host deletes it
+
+		_JetObject()
+		{
+			this->prototype = 0;
+			this->unmanaged = false;
+		}
+
+		_JetObject(_JetObjectBacking* backing) : GCVal(backing)
+		{
+			this->prototype = 0;
+			this->unmanaged = false;
+		}
+	};
 	//typedef std::map<std::string, Value>::iterator _JetObjectIterator;
-	typedef _JetObjectBacking::iterator _JetObjectIterator;
 
 	typedef std::vector<Value> _JetArrayBacking;
 	typedef GCVal<_JetArrayBacking* > _JetArray;//std::map<int, Value>*> _JetArray;
@@ -80,242 +198,291 @@ namespace Jet
 
 	class JetContext;
 
+	//where one of a closure's upvalues comes from when it is made
+	//either a local of the function making it, or one of that function's own upvalues
+	struct Capture
+	{
+		bool local;
+		unsigned int index;
+	};
+
 	struct Function
 	{
 		unsigned int ptr;
 		unsigned int args, locals, upvals;
+		unsigned int maxstack;//the most values it ever has on the operand stack, worked out by the verifier
 		bool vararg;
 		std::string name;
+		std::vector<Capture> captures;//one for each upvalue
 	};
 
+	struct Upvalue;
+
+	//a function along with the variables it captured, closures that capture the same variable share its upvalue
 	struct Closure
 	{
 		bool mark;
 		bool grey;
-		bool closed;//marks if the closure has gone out of its parent scope and was closed
 		unsigned short numupvals;
 
 		Function* prototype;
+		Upvalue** upvals;//follow the closure in its cell
+	};
 
-		union
-		{
-			Value* cupvals;//captured values used while closed
-			Value** upvals;//captured values used while not closed
-		};
-
-		Closure* prev;//parent closure
+	//a value is nan boxed into a single 64 bit word
+	//numbers are stored as plain doubles, every nan they produce is turned into the same quiet nan
+	//everything else uses a nan with one of the tags below in its top 16 bits and the payload in the other 48
+	//this relies on pointers fitting in 48 bits, which they do in user space on x64 and arm64
+	//integers only get 48 bits too, ones that dont fit become numbers like they do on overflow
+	enum ValueTag : unsigned int
+	{
+		//anything below TagFirst is a number, it starts just past negative infinity
+		TagFirst = 0xFFF1,
+		TagInteger = 0xFFF0 | (int)ValueType::Integer,
+		TagNativeFunction = 0xFFF0 | (int)ValueType::NativeFunction,
+		TagString = 0xFFF0 | (int)ValueType::String,
+		TagObject = 0xFFF0 | (int)ValueType::Object,
+		TagArray = 0xFFF0 | (int)ValueType::Array,
+		TagFunction = 0xFFF0 | (int)ValueType::Function,
+		TagUserdata = 0xFFF0 | (int)ValueType::Userdata,
+		TagCapture = 0xFFF0 | (int)ValueType::Capture,
+		TagInternedString,//a string whose characters belong to a _JetInternedString
+		TagCollectedString,//a string whose characters belong to a _JetGCString
+		TagNull = 0xFFFF,
 	};
 
 	struct Value
 	{
-		ValueType type;
-		union
-		{
-			double value;
-			long long integer;//todo implement me
-			//this is the new main struct
-			struct
-			{
-				union
-				{ //ok need to move string length out into the object itself 
-					//it would break the gc tho, so need to get alignment right	
-					_JetString* _string;
-					_JetObject* _object;
-					_JetArray* _array;
-					_JetUserdata* _userdata;
-				};
-				union
-				{
-					unsigned int length;//used for strings
-					_JetObject* prototype;
-				};
-			};
-
-			Closure* _function;
-			_JetNativeFunc func;//native func
-		};
+		unsigned long long bits;
+
+		static const unsigned long long PayloadMask = 0xFFFFFFFFFFFFULL;
+		static const unsigned long long CanonicalNaN = 0x7FF8000000000000ULL;
 
 		Value()
 		{
-			this->type = ValueType::Null;
-			//this->value = 0;
+			this->bits = (unsigned long long)TagNull << 48;
 		}
 
 		//move standard library to other file
 		Value(const char* str)
 		{
-			if (str == 0)
-				return;
+			this->Box(str ? TagString : TagNull, str);
+		}
 
-			type = ValueType::String;
-			length = strlen(str);
-			_string = (char*)str;
+		Value(_JetInternedString* str)
+		{
+			this->Box(TagInternedString, str->data);
+		}
+
+		Value(_JetGCString* str)
+		{
+			this->Box(TagCollectedString, str->data);
 		}
 
 		//plz dont delete my string
 		//crap, this is gonna be hell to figure out
 		Value(_JetString* str)
 		{
-			if (str == 0)
-				return;
-
-			type = ValueType::String;
-			length = strlen(str);
-			_string = str;
+			this->Box(str ? TagString : TagNull, str);
 		}
 
 		Value(_JetObject* obj)
 		{
-			this->type = ValueType::Object;
-			this->_object = obj;
-			this->prototype = 0;
+			this->Box(TagObject, obj);
 		}
 
 		Value(_JetArray* arr)
 		{
-			type = ValueType::Array;
-			this->_array = arr;
+			this->Box(TagArray, arr);
 		}
 
 		Value(double val)
 		{
-			type = ValueType::Number;
-			value = val;
+			if (val != val)
+				this->bits = CanonicalNaN;
+			else
+				memcpy(&this->bits, &val, sizeof(double));
 		}
 
 		Value(int val)
 		{
-			type = ValueType::Number;
-			value = val;
+			this->bits = ((unsigned long long)TagInteger << 48) | ((unsigned long long)(long long)val & PayloadMask);
+		}
+
+		Value(long long val)
+		{
+			//it fits if sign extending the low 48 bits gives it back
+			if ((long long)((unsigned long long)val << 16) >> 16 != val)
+				*this = Value((double)val);
+			else
+				this->bits = ((unsigned long long)TagInteger << 48) | ((unsigned long long)val & PayloadMask);
 		}
 
 		Value(_JetNativeFunc a)
 		{
-			type = ValueType::NativeFunction;
-			func = a;
+			this->Box(TagNativeFunction, (void*)a);
 		}
 
 		Value(Closure* func)
 		{
-			type = ValueType::Function;
-			_function = func;
+			this->Box(TagFunction, func);
 		}
 
-		explicit Value(_JetUserdata* userdata, _JetObject* prototype)
+		explicit Value(Upvalue* upvalue)
 		{
-			this->type = ValueType::Userdata;
-			this->_userdata = userdata;
-			this->prototype = prototype;
+			this->Box(TagCapture, upvalue);
 		}
 
-		Value& operator= (const _JetNativeFunc& func)
+		explicit Value(_JetUserdata* userdata)
 		{
-			return *this = Value(func);
+			this->Box(TagUserdata, userdata);
 		}
 
-		void SetPrototype(_JetObject* obj)
+		ValueType type() const
 		{
-			prototype = obj;
+			//IsNumber and IsInteger are quicker when that is all you need to know
+			unsigned int tag = (unsigned int)(this->bits >> 48);
+			if (tag < TagFirst)
+				return ValueType::Number;
+			else if (tag <= TagCapture)
+				return (ValueType)(tag & 15);
+			return tag == TagNull ? ValueType::Null : ValueType::String;
 		}
 
-		std::string ToString(int depth = 0) const
+		//the payload, each of these is only valid for its own type
+		double value() const
 		{
-			switch(this->type)
+			double d;
+			memcpy(&d, &this->bits, sizeof(double));
+			return d;
+		}
+
+		long long integer() const
+		{
+			//sign extends the 48 bits
+			return (long long)(this->bits << 16) >> 16;
+		}
+
+		_JetString* _string() const { return (_JetString*)this->Unbox(); }
+		_JetObject* _object() const { return (_JetObject*)this->Unbox(); }
+		_JetArray* _array() const { return (_JetArray*)this->Unbox(); }
+		_JetUserdata* _userdata() const { return (_JetUserdata*)this->Unbox(); }
+		Closure* _function() const { return (Closure*)this->Unbox(); }
+		Upvalue* _upvalue() const { return (Upvalue*)this->Unbox(); }
+		_JetNativeFunc func() const { return (_JetNativeFunc)this->Unbox(); }
+
+		//strings only, if _string belongs to a _JetInternedString
+		bool interned() const
+		{
+			return (this->bits >> 48) == TagInternedString;
+		}
+
+		//strings only, if _string belongs to a _JetGCString
+		bool collected() const
+		{
+			return (this->bits >> 48) == TagCollectedString;
+		}
+
+		Value& operator= (const _JetNativeFunc& func)
+		{
+			return *this = Value(func);
+		}
+
+		void SetPrototype(_JetObject* obj)
+		{
+			switch (type())
 			{
-			case ValueType::Null:
-				return "Null";
-			case ValueType::Number:
-				return std::to_string(this->value);
-			case ValueType::String:
-				return this->_string;
-			case ValueType::Function:
-				return "[Function "+this->_function->prototype->name+"]";//"[Function "+::std::to_string(this->_function->prototype->ptr)+"]";//"[Function "+this->_function->prototype->name+"]";
-			case ValueType::NativeFunction:
-				return "[NativeFunction "+std::to_string((unsigned int)this->func)+"]";
-			case ValueType::Array:
-				{
-					std::string str = "[\n";
-
-					if (depth++ > 3)
-						return "[Array " + std::to_string((int)this->_array)+"]";
-
-					int i = 0;
-					for (auto ii: *this->_array->ptr)
-					{
-						str += "\t";
-						str += std::to_string(i++);
-						str += " = ";
-						str += ii.ToString(depth) + "\n";
-					}
-					str += "]";
-					return str;
-				}
 			case ValueType::Object:
-				{
-					std::string str = "{\n";
-
-					if (depth++ > 3)
-						return "[Object " + std::to_string((int)this->_object)+"]";
-
-					for (auto ii: *this->_object->ptr)
-					{
-						str += "\t";
-						str += ii.first.ToString(depth);
-						str += " = ";
-						str += ii.second.ToString(depth) + "\n";
-					}
-					str += "}";
-					return str;
-				}
+				this->_object()->prototype = obj;
+				break;
 			case ValueType::Userdata:
-				{
-					return "[Userdata "+std::to_string((int)this->_userdata)+"]";
-				}
+				this->_userdata()->ptr.second = obj;
+				break;
 			default:
-				return "";
+				throw RuntimeException("Cannot set the prototype of type " + (std::string)ValueTypes[(int)this->type()]);
 			}
 		}
 
+		std::string ToString(int depth = 0) const;
+
 		template<class T>
 		inline T*& GetUserdata()
 		{
-			return (T*&)this->_userdata->ptr.first;
+			return (T*&)this->_userdata()->ptr.first;
 		}
 
 		const char* Type()
 		{
-			return ValueTypes[(int)this->type];
+			return ValueTypes[(int)this->type()];
 		}
 
 		operator int()
 		{
-			if (type == ValueType::Number)
-				return (int)value;
+			if (IsInteger())
+				return (int)integer();
+			else if (IsNumber())
+				return (int)value();
 
-			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->type] + " to int!");
+			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->type()] + " to int!");
 		};
 
 		operator double()
 		{
-			if (type == ValueType::Number)
-				return value;
+			if (IsNumber())
+				return value();
+			else if (IsInteger())
+				return (double)integer();
 
-			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->type] + " to double!");
+			throw RuntimeException("Cannot convert type " + (std::string)ValueTypes[(int)this->type()] + " to double!");
+		}
+
+		//quicker than comparing type(), these only look at the tag
+		bool IsNumber() const
+		{
+			return (this->bits >> 48) < TagFirst;
+		}
+
+		bool IsInteger() const
+		{
+			return (this->bits >> 48) == TagInteger;
+		}
+
+		//true for both number representations
+		bool IsNumeric() const
+		{
+			return IsNumber() || IsInteger();
+		}
+
+		//only valid if IsNumeric
+		double GetNumber() const
+		{
+			return IsInteger() ? (double)integer() : value();
+		}
+
+		//only valid if IsNumeric, truncates numbers
+		//throws for NaN and numbers outside of the 64 bit range rather than making something up
+		long long GetInteger() const
+		{
+			if (IsInteger())
+				return integer();
+			if (!(value() >= -9223372036854775808.0 && value() < 9223372036854775808.0))
+				throw RuntimeException("Cannot convert " + std::to_string(value()) + " to an integer!");
+			return (long long)value();
 		}
 
 		_JetObject* GetPrototype()
 		{
 			//add defaults for string and array
-			switch (type)
+			switch (type())
 			{
 			case ValueType::Array:
 				return 0;
 			case ValueType::Object:
-				return this->prototype;
+				return this->_object()->prototype;
 			case ValueType::String:
 				return 0;
 			case ValueType::Userdata:
-				return this->prototype;
+				return this->_userdata()->ptr.second;
 			default:
 				return 0;
 			}
@@ -376,270 +543,260 @@ namespace Jet
 		//c++ operator overloading resolution is dumb
 		//and wants to do integer[pointer-to-object]
 		//rather than value[(implicit value)const char*]
-		Value& operator[] (int key)
-		{
-			switch (type)
-			{
-			case ValueType::Array:
-				{
-					return (*this->_array->ptr)[key];
-				}
-			case ValueType::Object:
-				{
-					return (*this->_object->ptr)[key];
-				}
-			default:
-				throw RuntimeException("Cannot index type " + (std::string)ValueTypes[(int)this->type]);
-			}
-		}
-
-		Value& operator[] (const char* key)
-		{
-			switch (type)
-			{
-			case ValueType::Object:
-				{
-					return (*this->_object->ptr)[key];
-				}
-			default:
-				throw RuntimeException("Cannot index type " + (std::string)ValueTypes[(int)this->type]);
-			}
-		}
-
-		Value& operator[] (const Value& key)
-		{
-			switch (type)
-			{
-			case ValueType::Array:
-				{
-					return (*this->_array->ptr)[(int)key.value];
-				}
-			case ValueType::Object:
-				{
-					return (*this->_object->ptr)[key];
-				}
-			default:
-				throw RuntimeException("Cannot index type " + (std::string)ValueTypes[(int)this->type]);
-			}
-		}
+		Value& operator[] (int key);
+		Value& operator[] (const char* key);
+		Value& operator[] (const Value& key);
 
 		bool operator== (const Value& other) const
 		{
-			if (other.type != this->type)
+			if (other.type() != this->type())
+			{
+				//integers and numbers compare by value
+				if (this->IsInteger() && other.IsNumber())
+					return IntegerEqualsNumber(this->integer(), other.value());
+				else if (this->IsNumber() && other.IsInteger())
+					return IntegerEqualsNumber(other.integer(), this->value());
 				return false;
+			}
 
-			switch (this->type)
+			switch (this->type())
 			{
 			case ValueType::Number:
-				return other.value == this->value;
+				return other.value() == this->value();
+			case ValueType::Integer:
+				return other.integer() == this->integer();
 			case ValueType::Array:
-				return other._array == this->_array;
+				return other._array() == this->_array();
 			case ValueType::Function:
-				return other._function == this->_function;
+				return other._function() == this->_function();
 			case ValueType::NativeFunction:
-				return other.func == this->func;
+				return other.func() == this->func();
 			case ValueType::String:
-				return strcmp(other._string, this->_string) == 0;
+				//equal interned strings are always the same pointer
+				if (other._string() == this->_string())
+					return true;
+				else if (other.interned() && this->interned())
+					return false;
+				else if (other.collected() && this->collected() && _JetGCString::Get(other._string())->hash != _JetGCString::Get(this->_string())->hash)
+					return false;
+				return strcmp(other._string(), this->_string()) == 0;
 			case ValueType::Null:
 				return true;
 			case ValueType::Object:
-				return other._object == this->_object;
+				return other._object() == this->_object();
 			case ValueType::Userdata:
-				return other._userdata == this->_userdata;
+				return other._userdata() == this->_userdata();
 			default:
 				break;
 			}
 		}
 
-		Value CallMetamethod(const char* name, const Value* self)
-		{
-			JetContext* context;
-			auto iter = this->prototype->ptr->find(name);
-			if (iter != this->prototype->ptr->end())
-			{
-				//context->Call(
-				//return iter->second.
-			}
-		}
+		Value CallMetamethod(const char* name, const Value* self);
 
 		Value operator+( const Value &other )
 		{
-			switch(this->type)
+			if (IsInteger() && other.IsInteger())
+				return Value(integer()+other.integer());
+			else if (IsNumeric() && other.IsNumeric())
+				return Value(GetNumber()+other.GetNumber());
+			else if (type() == ValueType::Object)
 			{
-			case ValueType::Number:
-				if (other.type == ValueType::Number)
-					return Value(value+other.value);
-			case ValueType::Object:
-				{
-					if (this->prototype)
-					{
-
-					}
-					//throw JetRuntimeException("Cannot Add A String");
-					//if (other.type == ValueType::String)
-					//return Value((std::string(other.string.data) + std::string(this->string.data)).c_str());
-					//else
-					//return Value((other.ToString() + std::string(this->string.data)).c_str());
-				}
+				//do metamethod
 			}
 
-			throw RuntimeException("Cannot add two non-numeric types! " + (std::string)ValueTypes[(int)other.type] + " and " + (std::string)ValueTypes[(int)this->type]);
+			throw RuntimeException("Cannot add two non-numeric types! " + (std::string)ValueTypes[(int)other.type()] + " and " + (std::string)ValueTypes[(int)this->type()]);
 		};
 
 		Value operator-( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value(value-other.value);
-			else if (type == ValueType::Object)
+			if (IsInteger() && other.IsInteger())
+				return Value(integer()-other.integer());
+			else if (IsNumeric() && other.IsNumeric())
+				return Value(GetNumber()-other.GetNumber());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot subtract two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot subtract two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator*( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value(value*other.value);
-			else if (type == ValueType::Object)
+			if (IsInteger() && other.IsInteger())
+			{
+				long long result;
+				if (IntegerMul(integer(), other.integer(), result))
+					return Value(result);
+				return Value((double)integer()*(double)other.integer());
+			}
+			else if (IsNumeric() && other.IsNumeric())
+				return Value(GetNumber()*other.GetNumber());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot multiply two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot multiply two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
+		//division always results in a number
 		Value operator/( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value(value/other.value);
-			else if (type == ValueType::Object)
+			if (IsNumeric() && other.IsNumeric())
+				return Value(GetNumber()/other.GetNumber());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot divide two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot divide two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator%( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value((int)value%(int)other.value);
-			else if (type == ValueType::Object)
+			if (IsInteger() && other.IsInteger())
+			{
+				if (other.integer() == 0)
+					throw RuntimeException("Integer modulus by zero!");
+				else if (other.integer() == -1)//LLONG_MIN % -1 traps
+					return Value(0);
+				return Value(integer()%other.integer());
+			}
+			else if (IsNumeric() && other.IsNumeric())
+				return Value(fmod(GetNumber(), other.GetNumber()));
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot modulus two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot modulus two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator|( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value((int)value|(int)other.value);
-			else if (type == ValueType::Object)
+			if (IsNumeric() && other.IsNumeric())
+				return Value(GetInteger()|other.GetInteger());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot binary or two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot binary or two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator&( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value((int)value&(int)other.value);
-			else if (type == ValueType::Object)
+			if (IsNumeric() && other.IsNumeric())
+				return Value(GetInteger()&other.GetInteger());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot binary and two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot binary and two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator^( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value((int)value^(int)other.value);
-			else if (type == ValueType::Object)
+			if (IsNumeric() && other.IsNumeric())
+				return Value(GetInteger()^other.GetInteger());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot xor two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot xor two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator<<( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value((int)value<<(int)other.value);
-			else if (type == ValueType::Object)
+			if (IsNumeric() && other.IsNumeric())
+				return Value(IntegerShift(GetInteger(), other.GetInteger()));
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot left-shift two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot left-shift two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator>>( const Value &other )
 		{
-			if (type == ValueType::Number && other.type == ValueType::Number)
-				return Value((int)value>>(int)other.value);
-			else if (type == ValueType::Object)
+			if (IsNumeric() && other.IsNumeric())
+			{
+				long long shift = other.GetInteger();
+				return Value(IntegerShift(GetInteger(), shift == LLONG_MIN ? LLONG_MAX : -shift));
+			}
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot right-shift two non-numeric types! " + (std::string)ValueTypes[(int)this->type] + " and " + (std::string)ValueTypes[(int)other.type]);
+			throw RuntimeException("Cannot right-shift two non-numeric types! " + (std::string)ValueTypes[(int)this->type()] + " and " + (std::string)ValueTypes[(int)other.type()]);
 		};
 
 		Value operator~()
 		{
-			if (type == ValueType::Number)
-				return Value(~(int)value);
-			else if (type == ValueType::Object)
+			if (IsNumeric())
+				return Value(~GetInteger());
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot binary complement non-numeric type! " + (std::string)ValueTypes[(int)this->type]);
+			throw RuntimeException("Cannot binary complement non-numeric type! " + (std::string)ValueTypes[(int)this->type()]);
 		};
 
 		Value operator-()
 		{
-			if (type == ValueType::Number)
+			if (IsInteger())
 			{
-				return Value(-value);
+				return Value(-integer());
 			}
-			else if (type == ValueType::Object)
+			else if (IsNumber())
+			{
+				return Value(-value());
+			}
+			else if (type() == ValueType::Object)
 			{
 				//do metamethod
 			}
 
-			throw RuntimeException("Cannot negate non-numeric type! " + (std::string)ValueTypes[(int)this->type]);
+			throw RuntimeException("Cannot negate non-numeric type! " + (std::string)ValueTypes[(int)this->type()]);
 		}
 
-		//deletes all data associated
-		void Release()
+		//deletes a prototype made by NewPrototype
+		//does nothing for anything else, the collector owns the memory of objects and arrays
+		void Release();
+
+	private:
+		void Box(ValueTag tag, const void* ptr)
 		{
-			switch (type)
-			{
-			case ValueType::Array:
-				delete this->_array->ptr;
-				delete this->_array;
-				break;
-			case ValueType::Object:
-				delete this->_object->ptr;
-				delete this->_object;
-				break;
-			case ValueType::String:
-				break;
-			case ValueType::Userdata:
-				break;
-			}
+			this->bits = ((unsigned long long)tag << 48) | ((unsigned long long)(size_t)ptr & PayloadMask);
 		}
+
+		void* Unbox() const
+		{
+			return (void*)(size_t)(this->bits & PayloadMask);
+		}
+	};
+
+	static_assert(sizeof(Value) == 8, "Value should be nan boxed into a single word!");
+
+	//a variable captured by closures, like lua's upvalues
+	//while the function it belongs to is running it is open and points at the local on the stack
+	//when that function returns it is closed, the value is copied in and it points at the copy
+	struct Upvalue
+	{
+		bool mark;
+		bool grey;
+		Value* v;
+		Value closed;
+		Upvalue* next;//open upvalues are kept in a list, sorted by stack slot with the highest first
 	};
 }
 
+#include "JetObject.h"
+
 #endif
\ No newline at end of file